@@ -43,6 +43,8 @@
 #include <ndn-cpp/transport/tcp-transport.hpp>
 
 #include "external-observer.h"
+#include "scheduler.h"
+#include "metrics.h"
 
 #if NDN_CPP_HAVE_TIME_H
 #include <time.h>
@@ -65,10 +67,14 @@ namespace chrono_chat
      *   (hubPrefix + chatroomName + chatUsername + sessionNumber + sequence) is the full name of a chat message
      * @param observer The class that receives and displays chat messages.
      * @param face The face for broadcast sync and multicast chat interests.
+     * @param scheduler The scheduler for heartbeats and alive checks, processed in the 
+     * same thread as face.
      * @param keyChain The keychain to sign things with.
      * @param certificateName The name to locate the certificate.
      * @param heartbeatInterval The interval between two heartbeat data publishings
      * @param checkAliveWaitPeriod The wait period between onData, and checking if one participant has left
+     * @param metrics The registry of the chat.* metrics, which counts the chat interests and
+     * data of this participant, not the sync traffic of ChronoSync2013; a registry of its own if omitted.
      *
      * Constructor registers prefixes for both chat and broadcast namespaces.
      * This should be put into critical section, if the face is accessed by different threads
@@ -76,19 +82,30 @@ namespace chrono_chat
     Chat
       (const ndn::Name& broadcastPrefix,
        const std::string& screenName, const std::string& chatRoom,
-       const ndn::Name& hubPrefix, ChatObserver *observer, ndn::Face& face, ndn::KeyChain& keyChain,
-       ndn::Name certificateName, int heartbeatInterval = 10000, int checkAliveWaitPeriod = 20000)
+       const ndn::Name& hubPrefix, ChatObserver *observer, ndn::Face& face, 
+       ndnrtc_addon::Scheduler& scheduler, ndn::KeyChain& keyChain,
+       ndn::Name certificateName, int heartbeatInterval = 10000, int checkAliveWaitPeriod = 20000,
+       ndn::ptr_lib::shared_ptr<ndnrtc_addon::MetricsRegistry> metrics = 
+         ndn::ptr_lib::shared_ptr<ndnrtc_addon::MetricsRegistry>())
       : screen_name_(screenName), chatroom_(chatRoom), maxmsgcachelength_(100),
         isRecoverySyncState_(true), sync_lifetime_(5000.0), observer_(observer),
-        faceProcessor_(face), keyChain_(keyChain), certificateName_(certificateName),
+        faceProcessor_(face), scheduler_(scheduler), keyChain_(keyChain), certificateName_(certificateName),
         broadcastPrefix_(broadcastPrefix), enabled_(true), 
         heartbeatInterval_(heartbeatInterval), checkAliveWaitPeriod_(checkAliveWaitPeriod), 
-        chatDataFreshnessPeriod_(5000), prefixFromInstEnd_(4), prefixFromChatPrefixEnd_(2)
+        chatDataFreshnessPeriod_(5000), prefixFromInstEnd_(4), prefixFromChatPrefixEnd_(2),
+        metrics_(metrics ? metrics : ndn::ptr_lib::make_shared<ndnrtc_addon::MetricsRegistry>()),
+        interestsSent_(metrics_->getCounter("chat.interests_sent")),
+        interestsReceived_(metrics_->getCounter("chat.interests_received")),
+        dataSigned_(metrics_->getCounter("chat.data_signed"))
     {
       chat_usrname_ = Chat::getRandomString();
       chat_prefix_ = ndn::Name(hubPrefix).append(chatroom_).append(chat_usrname_);
       
-      session_ = (int)::round(getNowMilliseconds()  / 1000.0);
+      // The session tells this instance apart from others of the same screen name; a
+      // clock reading doesn't, for instances started together on a virtual clock
+      uint32_t session;
+      RAND_bytes((uint8_t *)&session, sizeof(session));
+      session_ = (int)(session & 0x7FFFFFFF);
       std::ostringstream tempStream;
       tempStream << screen_name_ << session_;
       usrname_ = tempStream.str();
@@ -162,14 +179,22 @@ namespace chrono_chat
     {
       return roster_;
     }
+
+    /**
+     * Return the registry of the chat.* metrics, which the host may snapshot from any thread.
+     */
+    ndn::ptr_lib::shared_ptr<ndnrtc_addon::MetricsRegistry>
+    getMetrics()
+    {
+      return metrics_;
+    }
   private:
     /**
-     * Use gettimeofday to return the current time in milliseconds.
-     * @return The current time in milliseconds since 1/1/1970, including fractions
-     * of a millisecond according to timeval.tv_usec.
+     * Return the current time in milliseconds according to the scheduler's clock,
+     * which is gettimeofday unless the scheduler was given another one.
      */
-    static ndn::MillisecondsSince1970
-    getNowMilliseconds();
+    ndn::MillisecondsSince1970
+    getNowMilliseconds() { return scheduler_.getNowMilliseconds(); }
 
     int 
     notifyObserver(MessageTypes type, const char *prefix, const char *name, const char *msg, double timestamp);
@@ -200,25 +225,20 @@ namespace chrono_chat
     chatTimeout(const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest);
 
     /**
-     * This repeatedly calls itself after a timeout to send a heartbeat message
+     * This repeatedly schedules itself to send a heartbeat message
      * (chat message type HELLO).
-     * This method has an "interest" argument because we use it as the onTimeout
-     * for Face.expressInterest.
      */
     void
-    heartbeat(const ndn::ptr_lib::shared_ptr<const ndn::Interest> &interest);
+    heartbeat();
 
     /**
-     * This is called after a timeout to check if the user with prefix has a newer
+     * This is scheduled to check if the user with prefix has a newer
      * sequence number than the given temp_seq. If not, assume the user is idle and
      * remove from the roster and print a leave message.
-     * This method has an "interest" argument because we use it as the onTimeout
-     * for Face.expressInterest.
      */
     void
     alive
-      (const ndn::ptr_lib::shared_ptr<const ndn::Interest> &interest, int temp_seq,
-       const std::string& name, int session, const std::string& prefix);
+      (int temp_seq, const std::string& name, int session, const std::string& prefix);
 
     /**
      * Append a new CachedMessage to msgcache, using given messageType and message,
@@ -236,15 +256,6 @@ namespace chrono_chat
     static void
     onRegisterFailed(const ndn::ptr_lib::shared_ptr<const ndn::Name>& prefix);
 
-    /**
-     * This is a do-nothing onData for using expressInterest for timeouts.
-     * This should never be called.
-     */
-    static void
-    dummyOnData
-      (const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest,
-       const ndn::ptr_lib::shared_ptr<ndn::Data>& data);
-    
     class CachedMessage {
     public:
       CachedMessage
@@ -295,6 +306,7 @@ namespace chrono_chat
     ndn::ptr_lib::shared_ptr<ndn::ChronoSync2013> sync_;
     
     ndn::Face& faceProcessor_;
+    ndnrtc_addon::Scheduler& scheduler_;
     ndn::KeyChain& keyChain_;
     ndn::Name certificateName_;
     
@@ -311,6 +323,11 @@ namespace chrono_chat
     int heartbeatInterval_;
     int checkAliveWaitPeriod_;
     int chatDataFreshnessPeriod_;
+
+    ndn::ptr_lib::shared_ptr<ndnrtc_addon::MetricsRegistry> metrics_;
+    ndnrtc_addon::Counter& interestsSent_;
+    ndnrtc_addon::Counter& interestsReceived_;
+    ndnrtc_addon::Counter& dataSigned_;
   };
 }
 
@@ -16,9 +16,14 @@
 #include <ndn-cpp/transport/tcp-transport.hpp>
 
 #include <sys/time.h>
+#include <openssl/rand.h>
 #include <iostream>
+#include <set>
+#include <unordered_map>
 
 #include "sync-based-discovery.h"
+#include "heartbeat-engine.h"
+#include "heartbeat-policy.h"
 #include "external-observer.h"
 #include "entity-serializer.h"
 
@@ -26,8 +31,6 @@
 // TODO: Different lifetimes could cause interest towards stopped self hosted entity to get reissued;
 //   explicit entity over still being verified.
 // TODO: sync interest does not seem to timeout; for an add/remove the same entry; freshness period problem?
-// TODO: Moving timeout count and other variables out of EntityInfoBase, so that passing nil entityInfo(from deserialize) to this library
-//   won't cause problems.
 
 // Updates 2016
 // TODO: digest interest length check; the unexpected prefix chrono-chat0.3 of ndncon's and flooding of local nfd issue
@@ -43,19 +46,59 @@ namespace entity_discovery
      * and published objects will be appended directly after broadcast prefix
      * @param observer The observer class for receiving and displaying discovery messages.
      * @param face The face for broadcast sync and multicast fetch interest.
+     * @param scheduler The scheduler for heartbeats and other delays, processed in the 
+     * same thread as face.
      * @param keyChain The keychain to sign things with.
      * @param certificateName The certificate name for locating the certificate.
+     * @param digestType The sync digest type passed to SyncBasedDiscovery.
+     * @param digestLogLength The sync digest log length passed to SyncBasedDiscovery.
+     * @param dataFormat The sync reply encoding passed to SyncBasedDiscovery.
+     * @param ibltCellCount The sync interest IBLT cell count passed to SyncBasedDiscovery.
+     * @param heartbeatWindow The maximum number of heartbeat interests in flight, 0 for no limit.
+     * @param leasePeriod The interval at which this instance renews the lease on its hosted
+     * entities, by publishing a new lease object in the sync state. Peers that see leases 
+     * stop heartbeats for the entities covered, until a lease is missing for two periods.
+     * 0 disables publishing leases; leases of others are followed regardless.
+     * Older peers take lease objects for entities, so enable it only when every peer supports it.
+     * @param heartbeatPolicy The intervals of heartbeats towards discovered entities, and 
+     * the number of missed ones that removes an entity.
+     * @param metrics The registry of the discovery.* metrics, and of the sync.* metrics
+     * of its SyncBasedDiscovery; a registry of its own if omitted.
      */
     EntityDiscovery
       (std::string broadcastPrefix, IDiscoveryObserver *observer, 
-       ndn::ptr_lib::shared_ptr<IEntitySerializer> serializer, ndn::Face& face, ndn::KeyChain& keyChain, 
-       ndn::Name certificateName)
-    :  defaultDataFreshnessPeriod_(2000), defaultKeepPeriod_(3000), 
-       defaultHeartbeatInterval_(2000), defaultTimeoutReexpressInterval_(300), 
-       broadcastPrefix_(broadcastPrefix), observer_(observer), serializer_(serializer), 
-       faceProcessor_(face), keyChain_(keyChain), 
-       certificateName_(certificateName), hostedEntitiesNum_(0), enabled_(true)
+       ndn::ptr_lib::shared_ptr<IEntitySerializer> serializer, ndn::Face& face, 
+       ndnrtc_addon::Scheduler& scheduler, ndn::KeyChain& keyChain, 
+       ndn::Name certificateName, SyncDigestType digestType = SyncDigestType::SHA256_FULL,
+       size_t digestLogLength = 0, SyncDataFormat dataFormat = SyncDataFormat::TEXT,
+       size_t ibltCellCount = 0, size_t heartbeatWindow = 256, 
+       ndn::Milliseconds leasePeriod = 0, 
+       const HeartbeatPolicy& heartbeatPolicy = HeartbeatPolicy(),
+       ndn::ptr_lib::shared_ptr<ndnrtc_addon::MetricsRegistry> metrics = 
+         ndn::ptr_lib::shared_ptr<ndnrtc_addon::MetricsRegistry>())
+    :  faceProcessor_(face), scheduler_(scheduler), keyChain_(keyChain), 
+       certificateName_(certificateName), broadcastPrefix_(broadcastPrefix), 
+       hostedEntitiesNum_(0), enabled_(true),
+       digestType_(digestType), digestLogLength_(digestLogLength),
+       dataFormat_(dataFormat), ibltCellCount_(ibltCellCount),
+       nameTable_(ndn::ptr_lib::make_shared<NameTable>()),
+       heartbeatEngine_
+         (scheduler, ndn::func_lib::bind(&EntityDiscovery::expressHeartbeatInterest, this, _1),
+          heartbeatWindow),
+       leasePeriod_(leasePeriod), leaseEpoch_(0), leaseVersion_(0),
+       defaultDataFreshnessPeriod_(2000), defaultKeepPeriod_(3000), 
+       defaultHeartbeatInterval_(2000), heartbeatPolicy_(heartbeatPolicy), 
+       observer_(observer), serializer_(serializer), 
+       metrics_(metrics ? metrics : ndn::ptr_lib::make_shared<ndnrtc_addon::MetricsRegistry>()),
+       interestsSent_(metrics_->getCounter("discovery.interests_sent")),
+       interestsReceived_(metrics_->getCounter("discovery.interests_received")),
+       dataSigned_(metrics_->getCounter("discovery.data_signed"))
     {
+      heartbeatEngine_.setLatencyHistogram(&metrics_->getHistogram("discovery.heartbeat_rtt_us"));
+      leasePrefix_ = ndn::Name(broadcastPrefix_).append("lease").toUri() + "/";
+      hostId_ = getRandomHostId();
+      // Versions of a restarted instance don't match what peers have
+      RAND_bytes((uint8_t *)&entityVersion_, sizeof(entityVersion_));
     };
   
     void
@@ -65,7 +108,8 @@ namespace entity_discovery
       
       syncBasedDiscovery_.reset(new SyncBasedDiscovery
         (broadcastPrefix_, bind(&EntityDiscovery::onReceivedSyncData, shared_from_this(), _1), 
-         faceProcessor_, keyChain_, certificateName_));
+         faceProcessor_, scheduler_, keyChain_, certificateName_, digestType_, digestLogLength_, dataFormat_,
+         ibltCellCount_, nameTable_, metrics_));
       syncBasedDiscovery_->start();
     }
   
@@ -76,7 +120,8 @@ namespace entity_discovery
      * if local peer's not publishing before
      * @param entityName string name of the entity.
      * @param localPrefix name prefix of the entity. (localPrefix + entityName) is the full name of the entity
-     * @param entityInfo the info of this entity.
+     * @param entityInfo the info of this entity. Replies to peers are serialized and signed
+     * once per version, so a changed entityInfo takes effect only when published again.
      * @return true, if entity name is not already published by this instance; false if otherwise.
      */
     bool 
@@ -94,47 +139,89 @@ namespace entity_discovery
     bool
     stopPublishingEntity(std::string entityName, ndn::Name prefix);
     
+    /**
+     * Publish entities in bulk, as publishEntity does one by one: one prefix registration, 
+     * localPrefix, covers the new ones, and is kept for the entities published under 
+     * localPrefix later; they change the sync state at once, with one digest recomputation 
+     * and one sync interest. Observers are notified of each entity.
+     * Interests under localPrefix for other names get no reply.
+     * @param entityNames string names of the entities.
+     * @param localPrefix name prefix of the entities.
+     * @param entityInfos the info of each entity in entityNames.
+     * @return the number of distinct entities published or updated.
+     * @throw std::runtime_error if entityInfos and entityNames differ in size.
+     */
+    size_t
+    publishEntities
+      (const std::vector<std::string>& entityNames, ndn::Name localPrefix,
+       const std::vector<ndn::ptr_lib::shared_ptr<EntityInfoBase> >& entityInfos);
+    
+    /**
+     * Stop publishing entities in bulk, as stopPublishingEntity does one by one, with
+     * one change of the sync state.
+     * @param entityNames string names of the entities to be stopped
+     * @param prefix name prefix of the entities to be stopped
+     * @return the number of entities hosted by this instance that were stopped.
+     */
+    size_t
+    stopPublishingEntities(const std::vector<std::string>& entityNames, ndn::Name prefix);
+    
     /**
      * getDiscoveredEntityList returns the copy of list of discovered entities
      */
     std::map<std::string, ndn::ptr_lib::shared_ptr<EntityInfoBase>>
-    getDiscoveredEntityList() { return discoveredEntityList_; };
+    getDiscoveredEntityList() { return getEntityList(EntityState::DISCOVERED); };
     
     /**
      * getHostedEntityList returns the copy of list of hosted entities
      */
     std::map<std::string, ndn::ptr_lib::shared_ptr<EntityInfoBase>>
-    getHostedEntityList() { return hostedEntityList_; };
+    getHostedEntityList() { return getEntityList(EntityState::HOSTED); };
     
     /**
-     * getEntity gets the entity info from list of entitys discovered or hosted
-     * The first entity with matching name will get returned.
+     * getEntity gets the entity info of a discovered or hosted entity,
+     * or a null pointer if there's none with that name.
      */
     ndn::ptr_lib::shared_ptr<EntityInfoBase>
     getEntity(std::string entityName) 
     {
-      std::map<std::string, ndn::ptr_lib::shared_ptr<EntityInfoBase>>::iterator item = discoveredEntityList_.find
-        (entityName);
-      if (item != discoveredEntityList_.end()) {
-        return item->second;
+      EntityTable::iterator item = findEntity(entityName);
+      if (item != entities_.end()) {
+        return item->second.info_;
       }
       else {
-        std::map<std::string, ndn::ptr_lib::shared_ptr<EntityInfoBase>>::iterator hostedItem = hostedEntityList_.find
-          (entityName);
-        if (hostedItem != hostedEntityList_.end()) {
-          return hostedItem->second;
-        }
-        else {
-          return ndn::ptr_lib::shared_ptr<EntityInfoBase>();
-        }
+        return ndn::ptr_lib::shared_ptr<EntityInfoBase>();
       }
     };
     
     
     ~EntityDiscovery() 
     {
+      for (EntityTable::iterator it = entities_.begin(); it != entities_.end(); it++) {
+        nameTable_->release(it->first);
+      }
     };
     
+    /**
+     * getHeartbeatEngine returns the engine pacing heartbeats, for its window and metrics.
+     */
+    HeartbeatEngine&
+    getHeartbeatEngine() { return heartbeatEngine_; };
+    
+    /**
+     * getSyncBasedDiscovery returns the sync of entity names, for its metrics; it's null
+     * until start is called.
+     */
+    ndn::ptr_lib::shared_ptr<SyncBasedDiscovery>
+    getSyncBasedDiscovery() { return syncBasedDiscovery_; };
+    
+    /**
+     * getMetrics returns the registry of the discovery.* and sync.* metrics, which the
+     * host may snapshot from any thread.
+     */
+    ndn::ptr_lib::shared_ptr<ndnrtc_addon::MetricsRegistry>
+    getMetrics() { return metrics_; };
+    
     /**
      * When calling shutdown, destroy all pending interests and remove all
      * registered prefixes.
@@ -143,15 +230,116 @@ namespace entity_discovery
      */
     void shutdown()
     {
+      std::set<uint64_t> registeredPrefixIds;
       syncBasedDiscovery_->shutdown();
+      heartbeatEngine_.shutdown();
       enabled_ = false;
       
-      for (std::map<std::string, ndn::ptr_lib::shared_ptr<EntityInfoBase>>::iterator it = hostedEntityList_.begin(); it != hostedEntityList_.end(); it++) {
-        faceProcessor_.removeRegisteredPrefix(it->second->getRegisteredPrefixId());
+      leaseEvent_.cancel();
+      for (std::map<std::string, Lease>::iterator it = leases_.begin(); it != leases_.end(); it++) {
+        it->second.expiryEvent_.cancel();
+      }
+      
+      for (EntityTable::iterator it = entities_.begin(); it != entities_.end(); it++) {
+        if (it->second.state_ == EntityState::HOSTED) {
+          registeredPrefixIds.insert(it->second.info_->getRegisteredPrefixId());
+        }
       }
+      // Entities published in bulk share a registration
+      for (std::set<uint64_t>::iterator it = registeredPrefixIds.begin(); it != registeredPrefixIds.end(); it++) {
+        faceProcessor_.removeRegisteredPrefix(*it);
+      }
+      sharedPrefixes_.clear();
+      sharedPrefixIds_.clear();
     }
     
   private:
+    enum class EntityState {
+      // Named in the sync state, and being fetched for the first time
+      QUERIED,
+      DISCOVERED,
+      HOSTED
+    };
+    
+    /**
+     * The one record of an entity this instance knows about, whether hosted here or 
+     * elsewhere.
+     */
+    class EntityRecord {
+    public:
+      EntityRecord(EntityState state = EntityState::QUERIED)
+      : state_(state), timeoutCount_(0), heartbeatInterval_(0)
+      {}
+      
+      EntityState state_;
+      // Missed heartbeats in a row, of a discovered entity
+      int timeoutCount_;
+      /**
+       * Drop what's cached of a hosted entity's replies, once its info changed.
+       */
+      void
+      clearReplies()
+      {
+        content_ = ndn::Blob();
+        reply_.reset();
+        sameReply_.reset();
+      }
+      
+      // Null while the entity is queried
+      ndn::ptr_lib::shared_ptr<EntityInfoBase> info_;
+      // info_ serialized: the reply it was deserialized from for a discovered entity, 
+      // which later replies are compared with byte for byte; cached once a peer asked 
+      // for it for a hosted one
+      ndn::Blob content_;
+      // The signed replies of a hosted entity to plain heartbeats, and to conditional 
+      // ones for the current version, cached once a peer asked for them
+      ndn::ptr_lib::shared_ptr<ndn::Data> reply_;
+      ndn::ptr_lib::shared_ptr<ndn::Data> sameReply_;
+      // The current heartbeat interval of a discovered entity
+      ndn::Milliseconds heartbeatInterval_;
+      // The host whose lease covers a discovered entity, if any
+      std::string hostId_;
+      // The version of info_: assigned here for a hosted entity, named by the replies
+      // of its host for a discovered one; empty if the host doesn't version replies
+      std::string version_;
+    };
+    
+    // Each record holds a reference to the name of its Id in nameTable_
+    typedef std::unordered_map<NameTable::Id, EntityRecord> EntityTable;
+    
+    EntityTable::iterator
+    findEntity(const std::string& entityName)
+    {
+      NameTable::Id id = nameTable_->find(entityName);
+      return id == NameTable::NONE ? entities_.end() : entities_.find(id);
+    }
+    
+    /**
+     * Add a record of entityName in state, unless there's one already.
+     * @return The record of entityName, and true if it was added.
+     */
+    std::pair<EntityTable::iterator, bool>
+    addEntity(const std::string& entityName, EntityState state);
+    
+    /**
+     * Erase the record of item, with its heartbeat and lease membership, so that its 
+     * Id can be given to another name.
+     */
+    void
+    eraseEntity(EntityTable::iterator item);
+    
+    std::map<std::string, ndn::ptr_lib::shared_ptr<EntityInfoBase>>
+    getEntityList(EntityState state)
+    {
+      std::map<std::string, ndn::ptr_lib::shared_ptr<EntityInfoBase>> entityList;
+      for (EntityTable::iterator it = entities_.begin(); it != entities_.end(); it++) {
+        if (it->second.state_ == state) {
+          entityList[nameTable_->get(it->first)] = it->second.info_;
+        }
+      }
+      return entityList;
+    }
+    
     /**
      * onReceivedSyncData is passed into syncBasedDiscovery, and called whenever 
      * syncData is received in syncBasedDiscovery.
@@ -173,30 +361,60 @@ namespace entity_discovery
      * Handles the ondata event for entity querying interest
      * For now, whenever data is received means the entity in question is ongoing.
      * The content should be entity description for later uses.
+     * An unchanged reply, and a "same" one, make no allocations here.
      */
     void 
     onData
-      (const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest,
+      (NameTable::Id entity, const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest,
        const ndn::ptr_lib::shared_ptr<ndn::Data>& data);
   
     /**
      * expressHeartbeatInterest expresses the interest for certain entity again,
-     * to learn if the entity is still going on. This is done like heartbeat with a 2 seconds
-     * default interval. Should switch to more efficient mechanism.
+     * to learn if the entity is still going on. heartbeatEngine_ calls this when the 
+     * entity's heartbeat is due, at intervals given by heartbeatPolicy_.
      */
     void
-    expressHeartbeatInterest
-      (const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest,
-       const ndn::ptr_lib::shared_ptr<const ndn::Interest>& entityInterest);
+    expressHeartbeatInterest(NameTable::Id entity);
     
     /**
      * Remove registered prefix happens after a few seconds after stop hosting entity;
      * So that other peers may fetch "entity over" with heartbeat interest.
      */
     void
-    removeRegisteredPrefix
-      (const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest,
-       ndn::Name entityName);
+    removeRegisteredPrefix(ndn::Name entityName);
+    
+    void
+    removeRegisteredPrefixes(std::vector<ndn::Name> entityNames);
+    
+    /**
+     * Return the registration of localPrefix shared by entities published under it,
+     * registering it if there's none, and count entityCount more entities using it.
+     */
+    uint64_t
+    acquireSharedPrefix(const ndn::Name& localPrefix, size_t entityCount);
+    
+    /**
+     * Remove the prefix registration of a hosted entity, once no other entity shares it.
+     */
+    void
+    releaseRegisteredPrefix(uint64_t registeredPrefixId);
+    
+    /**
+     * Make item, or a new record if it's the end, the record of the hosted entity fullName, 
+     * answering interests through registeredPrefixId.
+     */
+    void
+    hostEntity
+      (EntityTable::iterator item, const std::string& fullName, 
+       ndn::ptr_lib::shared_ptr<EntityInfoBase> entityInfo, uint64_t registeredPrefixId);
+    
+    /**
+     * Replace the info of the hosted entity of item, as publishing it again does.
+     */
+    void
+    updateHostedEntity
+      (EntityTable::iterator item, const std::string& fullName, 
+       ndn::ptr_lib::shared_ptr<EntityInfoBase> entityInfo);
     
     /**
      * This works as expressHeartbeatInterest's onData callback.
@@ -207,14 +425,6 @@ namespace entity_discovery
       (const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest,
        const ndn::ptr_lib::shared_ptr<ndn::Data>& data);
   
-    void 
-    dummyOnData
-      (const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest,
-       const ndn::ptr_lib::shared_ptr<ndn::Data>& data)
-    {
-      std::cout << "Dummy onData called by EntityDiscovery." << std::endl;
-    };
-  
     /**
      * Handles the timeout event for unicast entity querying interest:
      * For now, receiving one timeout means the entity being queried is over.
@@ -222,7 +432,14 @@ namespace entity_discovery
      */
     void
     onTimeout
-      (const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest);
+      (NameTable::Id entity, const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest);
+    
+    /**
+     * Return the record of entity if interestName, a heartbeat expressed for it, names 
+     * it still: its Id may have been given to another name since.
+     */
+    EntityTable::iterator
+    findHeartbeatEntity(NameTable::Id entity, const ndn::Name& interestName);
   
     void
     onRegisterFailed
@@ -231,12 +448,98 @@ namespace entity_discovery
       std::cout << "Prefix " << prefix->toUri() << " registration failed." << std::endl;
     };
     
+    /**
+     * Replace this instance's lease object in the sync state with one of the next epoch, 
+     * and schedule the next renewal; withdraw it if no entities are hosted.
+     */
+    void
+    renewLease() { renewLeaseWith(std::vector<std::string>()); }
+    
+    /**
+     * Renew the lease as renewLease does, publishing names in the same change of the 
+     * sync state, with one digest recomputation.
+     */
+    void
+    renewLeaseWith(const std::vector<std::string>& names);
+    
+    /**
+     * If object is a lease object of another host, keep the newest epoch of it in the 
+     * sync state and extend the host's lease, refreshing its entities if its version 
+     * changed.
+     * @return true if object is a lease object, which is not an entity.
+     */
+    bool
+    onLeaseObject(const std::string& object);
+    
+    /**
+     * Fall back to heartbeats for the entities of hostId, if its lease was not 
+     * renewed since epoch.
+     */
+    void
+    onLeaseExpired(std::string hostId, uint64_t epoch);
+    
+    /**
+     * If the reply for entity named the lease of hostId, record entity as covered by it.
+     * @return true if the entity is covered by a current lease, and needs no heartbeat.
+     */
+    bool
+    updateEntityHost
+      (NameTable::Id entity, EntityRecord& record, const ndn::Name::Component *hostId);
+    
+    /**
+     * Drop entity from the lease of its host, when it's removed or stopped.
+     */
+    void
+    forgetEntityHost(NameTable::Id entity, EntityRecord& record);
+    
+    /**
+     * Make a signed and encoded reply for a hosted entity, naming this instance's 
+     * lease if it has one.
+     */
+    ndn::ptr_lib::shared_ptr<ndn::Data>
+    makeReply
+      (const ndn::Name& name, const ndn::Blob& content, ndn::Milliseconds freshnessPeriod);
+    
+    static std::string
+    getRandomHostId();
+    
+    std::string
+    getNextVersion();
+    
+    static bool
+    isComponent(const ndn::Name::Component& component, const std::string& value);
+    
+    /**
+     * Return the number of components of interestName that name the entity: a 
+     * conditional heartbeat adds since/<version> to them.
+     */
+    static size_t
+    getEntityNameSize(const ndn::Name& interestName);
+    
+    /**
+     * Find the version/<version> and lease/<hostId> pairs that a reply adds to the 
+     * entity name, after the since/<version> of a conditional heartbeat. The components
+     * are left null if the reply has no such pair.
+     */
+    static void
+    parseReplyName
+      (const ndn::Name& dataName, size_t entityNameSize, 
+       const ndn::Name::Component *& version, const ndn::Name::Component *& hostId);
+    
+    /**
+     * Set value to component, or clear it if there's no component; value is left as 
+     * it is if it holds component already.
+     */
+    static void
+    assignComponent(std::string& value, const ndn::Name::Component *component);
+    
     std::string entitiesToString();
     
     void 
     notifyObserver(MessageTypes type, const char *msg, double timestamp);
     
     ndn::Face& faceProcessor_;
+    ndnrtc_addon::Scheduler& scheduler_;
     ndn::KeyChain& keyChain_;
     
     ndn::Name certificateName_;
@@ -244,25 +547,80 @@ namespace entity_discovery
     
     int hostedEntitiesNum_;
     bool enabled_;
+    class SharedPrefix {
+    public:
+      SharedPrefix(const std::string& prefix)
+      : prefix_(prefix), entityCount_(0)
+      {}
+      
+      std::string prefix_;
+      // The hosted entities using the registration
+      size_t entityCount_;
+    };
+    
+    // Prefix registrations shared by entities published under a prefix, by registered 
+    // prefix id, and the id of each prefix
+    std::map<uint64_t, SharedPrefix> sharedPrefixes_;
+    std::map<std::string, uint64_t> sharedPrefixIds_;
+    
+    SyncDigestType digestType_;
+    size_t digestLogLength_;
+    SyncDataFormat dataFormat_;
+    size_t ibltCellCount_;
+    
+    // Names of entities, shared with syncBasedDiscovery_ so that each is stored once
+    ndn::ptr_lib::shared_ptr<NameTable> nameTable_;
+    HeartbeatEngine heartbeatEngine_;
+    
+    class Lease {
+    public:
+      Lease()
+      : epoch_(0), version_(0)
+      {}
+      
+      // The lease object in the sync state, empty once the lease expired
+      std::string object_;
+      uint64_t epoch_;
+      // Changes when an entity of the host is updated or stopped
+      uint64_t version_;
+      ndnrtc_addon::Scheduler::EventHandle expiryEvent_;
+      std::set<NameTable::Id> entities_;
+    };
+    
+    ndn::Milliseconds leasePeriod_;
+    // Lease objects are leasePrefix_ + hostId/period/version/epoch
+    std::string leasePrefix_;
+    std::string hostId_;
+    uint64_t leaseEpoch_;
+    uint64_t leaseVersion_;
+    std::string leaseObject_;
+    ndnrtc_addon::Scheduler::EventHandle leaseEvent_;
+    
+    // The last version given to a hosted entity
+    uint64_t entityVersion_;
+    
+    // Leases of other hosts by host id
+    std::map<std::string, Lease> leases_;
     
     const ndn::Milliseconds defaultDataFreshnessPeriod_;
     const ndn::Milliseconds defaultKeepPeriod_;
+    // The heartbeat interest lifetime
     const ndn::Milliseconds defaultHeartbeatInterval_;
-    const ndn::Milliseconds defaultTimeoutReexpressInterval_;
-  
-    // List of discovered entities.
-    std::map<std::string, ndn::ptr_lib::shared_ptr<EntityInfoBase>> discoveredEntityList_;
-    // List of entities that are being expressed interest towards,
-    // this includes discoveredEntitiesList_ and unverified entities.
-    std::vector<std::string> queriedEntityList_;
     
-    // List of hosted entities.
-    std::map<std::string, ndn::ptr_lib::shared_ptr<EntityInfoBase>> hostedEntityList_;
+    HeartbeatPolicy heartbeatPolicy_;
+  
+    // Queried, discovered and hosted entities, by the Id of their full name
+    EntityTable entities_;
     
     ndn::ptr_lib::shared_ptr<SyncBasedDiscovery> syncBasedDiscovery_;
     IDiscoveryObserver *observer_;
     
     ndn::ptr_lib::shared_ptr<IEntitySerializer> serializer_;
+    
+    ndn::ptr_lib::shared_ptr<ndnrtc_addon::MetricsRegistry> metrics_;
+    ndnrtc_addon::Counter& interestsSent_;
+    ndnrtc_addon::Counter& interestsReceived_;
+    ndnrtc_addon::Counter& dataSigned_;
   };
 }
 
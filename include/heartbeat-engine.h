@@ -0,0 +1,213 @@
+// HeartbeatEngine paces the heartbeat interests EntityDiscovery expresses towards
+// discovered entities.
+
+#ifndef __ndnrtc__addon__heartbeat__engine__
+#define __ndnrtc__addon__heartbeat__engine__
+
+#include <ndn-cpp/ndn-cpp-config.h>
+#include <ndn-cpp/common.hpp>
+
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "scheduler.h"
+#include "name-table.h"
+#include "metrics.h"
+
+namespace entity_discovery
+{
+  /**
+   * HeartbeatEngine keeps the due heartbeats of all entities, by the NameTable Id of 
+   * their names, in buckets of
+   * bucketWidth milliseconds, with one scheduler event per bucket instead of one per
+   * entity. Each due time is moved by a random fraction of the delay, up to jitter, so
+   * that entities discovered together drift apart instead of being polled in bursts.
+   * Due heartbeats are sent through onHeartbeatDue as long as fewer than window of
+   * them are in flight; the others wait in order for a finished one.
+   *
+   * The user calls onHeartbeatDone when the heartbeat interest gets data or times out,
+   * and schedule again to keep the entity polled.
+   */
+  class HeartbeatEngine
+  {
+  public:
+    typedef ndn::func_lib::function<void(NameTable::Id entity)> OnHeartbeatDue;
+
+    /**
+     * Constructor
+     * @param scheduler The scheduler to run the buckets from.
+     * @param onHeartbeatDue Called with the entity to express its heartbeat interest.
+     * @param window The maximum number of heartbeats in flight, 0 for no limit.
+     * @param bucketWidth The width of a bucket of due times in milliseconds.
+     * @param jitter The largest fraction of a delay a due time moves by, either way.
+     */
+    HeartbeatEngine
+      (ndnrtc_addon::Scheduler& scheduler, const OnHeartbeatDue& onHeartbeatDue,
+       size_t window = 256, ndn::Milliseconds bucketWidth = 50, double jitter = 0.1);
+
+    /**
+     * Schedule the heartbeat of entity after about delay milliseconds, replacing
+     * the one it has scheduled, if any. A heartbeat in flight keeps its window slot 
+     * until onHeartbeatDone, and the new one is scheduled then, for the same time.
+     */
+    void
+    schedule(NameTable::Id entity, ndn::Milliseconds delay);
+
+    /**
+     * Drop the heartbeat of entity, scheduled or in flight. The user cancels the 
+     * heartbeat before releasing the Id.
+     */
+    void
+    cancel(NameTable::Id entity);
+
+    /**
+     * Mark the heartbeat of entity as finished, which frees its window slot.
+     * This does nothing if entity has no heartbeat in flight, so it may be called
+     * for interests not sent by the engine.
+     * @param isAnswered True if data came back, false if the interest timed out.
+     */
+    void
+    onHeartbeatDone(NameTable::Id entity, bool isAnswered);
+
+    /**
+     * Drop all heartbeats and cancel the bucket events.
+     */
+    void
+    shutdown();
+
+    /**
+     * Set the maximum number of heartbeats in flight, 0 for no limit.
+     */
+    void
+    setWindow(size_t window)
+    {
+      window_ = window;
+      sendReady();
+    }
+
+    size_t
+    getWindow() const { return window_; }
+
+    size_t
+    getInFlightCount() const { return inFlightCount_; }
+
+    /**
+     * Return the number of entities with a heartbeat scheduled, waiting or in flight.
+     */
+    size_t
+    size() const { return entries_.size(); }
+
+    uint64_t
+    getSentCount() const { return sentCount_; }
+
+    uint64_t
+    getAnsweredCount() const { return answeredCount_; }
+
+    uint64_t
+    getTimedOutCount() const { return timedOutCount_; }
+
+    /**
+     * Return the number of heartbeats that waited for the window when due.
+     */
+    uint64_t
+    getDeferredCount() const { return deferredCount_; }
+
+    /**
+     * Return the heartbeats sent per second since construction or resetMetrics.
+     */
+    double
+    getSendRate() const;
+
+    /**
+     * Return the mean time from sending a heartbeat to its data, in milliseconds.
+     */
+    double
+    getAverageLatency() const
+    {
+      return answeredCount_ == 0 ? 0 : latencySum_ / answeredCount_;
+    }
+
+    ndn::Milliseconds
+    getMaxLatency() const { return maxLatency_; }
+
+    /**
+     * Record the time from sending each answered heartbeat to its data in histogram,
+     * in microseconds, or stop recording if histogram is null. Unlike the metrics
+     * above, resetMetrics leaves the histogram as is.
+     */
+    void
+    setLatencyHistogram(ndnrtc_addon::Histogram *histogram) { latencyHistogram_ = histogram; }
+
+    void
+    resetMetrics();
+
+  private:
+    enum class State {
+      SCHEDULED,
+      READY,
+      IN_FLIGHT
+    };
+
+    class Entry {
+    public:
+      Entry()
+      : state_(State::SCHEDULED), generation_(0), sendTime_(0), isRescheduled_(false),
+        rescheduleTime_(0)
+      {}
+
+      State state_;
+      // Tells a bucket or queue slot from the slots of an earlier schedule call
+      uint64_t generation_;
+      ndn::MillisecondsSince1970 sendTime_;
+      // A heartbeat in flight that was scheduled again, and the time it's due
+      bool isRescheduled_;
+      ndn::MillisecondsSince1970 rescheduleTime_;
+    };
+
+    typedef std::pair<NameTable::Id, uint64_t> Slot;
+
+    class Bucket {
+    public:
+      std::vector<Slot> slots_;
+      ndnrtc_addon::Scheduler::EventHandle event_;
+    };
+
+    /**
+     * Move the heartbeats of bucket whose generation still matches to the ready queue.
+     */
+    void
+    onBucketDue(uint64_t bucket);
+
+    /**
+     * Send ready heartbeats in order while the window allows.
+     */
+    void
+    sendReady();
+
+    ndnrtc_addon::Scheduler& scheduler_;
+    OnHeartbeatDue onHeartbeatDue_;
+    size_t window_;
+    ndn::Milliseconds bucketWidth_;
+    double jitter_;
+
+    std::unordered_map<NameTable::Id, Entry> entries_;
+    std::map<uint64_t, Bucket> buckets_;
+    std::deque<Slot> ready_;
+    size_t inFlightCount_;
+    uint64_t generation_;
+    uint64_t random_;
+
+    ndn::MillisecondsSince1970 metricsStartTime_;
+    uint64_t sentCount_;
+    uint64_t answeredCount_;
+    uint64_t timedOutCount_;
+    uint64_t deferredCount_;
+    double latencySum_;
+    ndn::Milliseconds maxLatency_;
+    ndnrtc_addon::Histogram *latencyHistogram_;
+  };
+}
+
+#endif
@@ -0,0 +1,74 @@
+// HeartbeatPolicy decides how often EntityDiscovery polls a discovered entity,
+// and how many missed heartbeats remove it.
+
+#ifndef __ndnrtc__addon__heartbeat__policy__
+#define __ndnrtc__addon__heartbeat__policy__
+
+#include <ndn-cpp/ndn-cpp-config.h>
+#include <ndn-cpp/common.hpp>
+
+#include "entity-info.h"
+
+namespace entity_discovery
+{
+  /**
+   * A discovered entity is polled every minInterval at first. Each answered heartbeat
+   * that finds the entity unchanged multiplies its interval by backoffFactor, up to
+   * maxInterval, so long-lived stable entities cost less; a missed heartbeat or a SET
+   * change puts it back to minInterval. A missed heartbeat is re-expressed after
+   * reexpressInterval, and (timeoutCount + 2) misses in a row remove the entity.
+   *
+   * The default policy polls every 2 seconds, as EntityDiscovery always did.
+   */
+  class HeartbeatPolicy
+  {
+  public:
+    HeartbeatPolicy
+      (ndn::Milliseconds minInterval = 2000, ndn::Milliseconds maxInterval = 2000,
+       double backoffFactor = 1, ndn::Milliseconds reexpressInterval = 300,
+       int timeoutCount = TIMEOUTCOUNT)
+    : minInterval_(minInterval), maxInterval_(maxInterval < minInterval ? minInterval : maxInterval),
+      backoffFactor_(backoffFactor < 1 ? 1 : backoffFactor), reexpressInterval_(reexpressInterval),
+      timeoutCount_(timeoutCount)
+    {}
+
+    /**
+     * Return the interval after an answered heartbeat.
+     * @param interval The interval that led to this heartbeat.
+     * @param isChanged True if the answer changed the entity.
+     */
+    ndn::Milliseconds
+    getNextInterval(ndn::Milliseconds interval, bool isChanged) const
+    {
+      if (isChanged || interval < minInterval_) {
+        return minInterval_;
+      }
+      interval *= backoffFactor_;
+      return interval > maxInterval_ ? maxInterval_ : interval;
+    }
+
+    ndn::Milliseconds
+    getMinInterval() const { return minInterval_; }
+
+    ndn::Milliseconds
+    getMaxInterval() const { return maxInterval_; }
+
+    double
+    getBackoffFactor() const { return backoffFactor_; }
+
+    ndn::Milliseconds
+    getReexpressInterval() const { return reexpressInterval_; }
+
+    int
+    getTimeoutCount() const { return timeoutCount_; }
+
+  private:
+    ndn::Milliseconds minInterval_;
+    ndn::Milliseconds maxInterval_;
+    double backoffFactor_;
+    ndn::Milliseconds reexpressInterval_;
+    int timeoutCount_;
+  };
+}
+
+#endif
@@ -0,0 +1,337 @@
+// MetricsRegistry keeps the counters, gauges and latency histograms of Chat,
+// EntityDiscovery and SyncBasedDiscovery, which the host process reads with snapshot,
+// from any thread.
+
+#ifndef __ndnrtc__addon__metrics__
+#define __ndnrtc__addon__metrics__
+
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ndnrtc_addon
+{
+  /**
+   * A count that only goes up, such as the interests sent.
+   */
+  class Counter
+  {
+  public:
+    Counter()
+    : value_(0)
+    {}
+
+    void
+    increment(uint64_t count = 1) { value_.fetch_add(count, std::memory_order_relaxed); }
+
+    uint64_t
+    get() const { return value_.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<uint64_t> value_;
+  };
+
+  /**
+   * A value that goes up and down, such as the size of a table.
+   */
+  class Gauge
+  {
+  public:
+    Gauge()
+    : value_(0)
+    {}
+
+    void
+    set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+
+    void
+    add(int64_t delta) { value_.fetch_add(delta, std::memory_order_relaxed); }
+
+    int64_t
+    get() const { return value_.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<int64_t> value_;
+  };
+
+  /**
+   * The values of a Histogram at the time of a snapshot.
+   */
+  class HistogramSnapshot
+  {
+  public:
+    HistogramSnapshot()
+    : count_(0), sum_(0), min_(0), max_(0)
+    {}
+
+    /**
+     * Return the smallest value that fraction of the recorded values are at or below,
+     * rounded up to the end of its bucket, and at most max_; 0 if nothing was recorded.
+     */
+    uint64_t
+    getPercentile(double fraction) const
+    {
+      uint64_t rank = (uint64_t)(fraction * count_ + 0.5);
+      uint64_t seen = 0;
+      for (size_t i = 0; i < buckets_.size(); ++i) {
+        seen += buckets_[i].second;
+        if (seen >= rank && seen > 0) {
+          return buckets_[i].first < max_ ? buckets_[i].first : max_;
+        }
+      }
+      return max_;
+    }
+
+    double
+    getMean() const { return count_ == 0 ? 0 : (double)sum_ / count_; }
+
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t min_;
+    uint64_t max_;
+    // The largest value of each non-empty bucket with its count, in increasing order
+    std::vector<std::pair<uint64_t, uint64_t> > buckets_;
+  };
+
+  /**
+   * A Histogram counts values in log-linear buckets, as HdrHistogram does: values below
+   * SUB_BUCKETS have a bucket each, and every power of two above is split in SUB_BUCKETS
+   * buckets, so that a value is known to within 1/SUB_BUCKETS of itself over the whole
+   * uint64_t range, with a fixed array of counters. Recording is a few atomic additions.
+   */
+  class Histogram
+  {
+  public:
+    static const size_t SUB_BUCKET_BITS = 4;
+    static const size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const size_t BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    Histogram()
+    : count_(0), sum_(0), min_(UINT64_MAX), max_(0)
+    {
+      for (size_t i = 0; i < BUCKETS; ++i) {
+        buckets_[i].store(0, std::memory_order_relaxed);
+      }
+    }
+
+    void
+    record(uint64_t value)
+    {
+      buckets_[getBucket(value)].fetch_add(1, std::memory_order_relaxed);
+      count_.fetch_add(1, std::memory_order_relaxed);
+      sum_.fetch_add(value, std::memory_order_relaxed);
+
+      uint64_t min = min_.load(std::memory_order_relaxed);
+      while (value < min && !min_.compare_exchange_weak(min, value, std::memory_order_relaxed)) {}
+      uint64_t max = max_.load(std::memory_order_relaxed);
+      while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+    }
+
+    /**
+     * Each field is read atomically, but values recorded meanwhile may be counted in
+     * some fields and not in others.
+     */
+    HistogramSnapshot
+    snapshot() const
+    {
+      HistogramSnapshot result;
+      for (size_t i = 0; i < BUCKETS; ++i) {
+        uint64_t count = buckets_[i].load(std::memory_order_relaxed);
+        if (count > 0) {
+          result.buckets_.push_back(std::make_pair(getBucketMax(i), count));
+          result.count_ += count;
+        }
+      }
+      result.sum_ = sum_.load(std::memory_order_relaxed);
+      if (result.count_ > 0) {
+        result.min_ = min_.load(std::memory_order_relaxed);
+        result.max_ = max_.load(std::memory_order_relaxed);
+      }
+      return result;
+    }
+
+  private:
+    static size_t
+    getBucket(uint64_t value)
+    {
+      if (value < SUB_BUCKETS) {
+        return value;
+      }
+      // value >> shift is in [SUB_BUCKETS, 2 * SUB_BUCKETS)
+      size_t shift = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS;
+      return shift * SUB_BUCKETS + (value >> shift);
+    }
+
+    static uint64_t
+    getBucketMax(size_t bucket)
+    {
+      if (bucket < SUB_BUCKETS) {
+        return bucket;
+      }
+      size_t shift = bucket / SUB_BUCKETS - 1;
+      // Wraps to UINT64_MAX for the last bucket
+      return ((uint64_t)(bucket - shift * SUB_BUCKETS + 1) << shift) - 1;
+    }
+
+    std::atomic<uint64_t> buckets_[BUCKETS];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> min_;
+    std::atomic<uint64_t> max_;
+  };
+
+  /**
+   * The values of every metric of a MetricsRegistry, by name.
+   */
+  class MetricsSnapshot
+  {
+  public:
+    /**
+     * Return one "name value" line per counter and gauge, and per histogram the lines
+     * name.count, name.mean, name.min, name.p50, name.p90, name.p99 and name.max.
+     */
+    std::string
+    toString() const
+    {
+      std::ostringstream result;
+      for (std::map<std::string, uint64_t>::const_iterator it = counters_.begin();
+           it != counters_.end(); ++it) {
+        result << it->first << " " << it->second << "\n";
+      }
+      for (std::map<std::string, int64_t>::const_iterator it = gauges_.begin();
+           it != gauges_.end(); ++it) {
+        result << it->first << " " << it->second << "\n";
+      }
+      for (std::map<std::string, HistogramSnapshot>::const_iterator it = histograms_.begin();
+           it != histograms_.end(); ++it) {
+        const HistogramSnapshot& histogram = it->second;
+        result << it->first << ".count " << histogram.count_ << "\n"
+               << it->first << ".mean " << histogram.getMean() << "\n"
+               << it->first << ".min " << histogram.min_ << "\n"
+               << it->first << ".p50 " << histogram.getPercentile(0.5) << "\n"
+               << it->first << ".p90 " << histogram.getPercentile(0.9) << "\n"
+               << it->first << ".p99 " << histogram.getPercentile(0.99) << "\n"
+               << it->first << ".max " << histogram.max_ << "\n";
+      }
+      return result.str();
+    }
+
+    std::map<std::string, uint64_t> counters_;
+    std::map<std::string, int64_t> gauges_;
+    std::map<std::string, HistogramSnapshot> histograms_;
+  };
+
+  /**
+   * MetricsRegistry names the metrics of one or more instances. Instances look their
+   * metrics up once, when they're constructed, and keep the references, which stay
+   * valid as long as the registry. Each kind of metric is a linked list that only
+   * grows, at its head, so that lookups and snapshot never lock, and can run in
+   * another thread than the one updating the metrics.
+   *
+   * Instances given the same registry share the metrics of the same name.
+   */
+  class MetricsRegistry
+  {
+  public:
+    MetricsRegistry()
+    : counters_(0), gauges_(0), histograms_(0)
+    {}
+
+    ~MetricsRegistry()
+    {
+      deleteAll(counters_);
+      deleteAll(gauges_);
+      deleteAll(histograms_);
+    }
+
+    /**
+     * Return the counter of name, adding it if it's new.
+     */
+    Counter&
+    getCounter(const std::string& name) { return getOrAdd(counters_, name); }
+
+    Gauge&
+    getGauge(const std::string& name) { return getOrAdd(gauges_, name); }
+
+    Histogram&
+    getHistogram(const std::string& name) { return getOrAdd(histograms_, name); }
+
+    MetricsSnapshot
+    snapshot() const
+    {
+      MetricsSnapshot result;
+      for (Node<Counter> *node = counters_.load(std::memory_order_acquire); node;
+           node = node->next_) {
+        result.counters_[node->name_] = node->metric_.get();
+      }
+      for (Node<Gauge> *node = gauges_.load(std::memory_order_acquire); node;
+           node = node->next_) {
+        result.gauges_[node->name_] = node->metric_.get();
+      }
+      for (Node<Histogram> *node = histograms_.load(std::memory_order_acquire); node;
+           node = node->next_) {
+        result.histograms_[node->name_] = node->metric_.snapshot();
+      }
+      return result;
+    }
+
+  private:
+    MetricsRegistry(const MetricsRegistry&);
+    MetricsRegistry& operator=(const MetricsRegistry&);
+
+    template<class Metric> class Node {
+    public:
+      Node(const std::string& name)
+      : name_(name), next_(0)
+      {}
+
+      const std::string name_;
+      Metric metric_;
+      Node *next_;
+    };
+
+    template<class Metric> static Metric&
+    getOrAdd(std::atomic<Node<Metric> *>& head, const std::string& name)
+    {
+      Node<Metric> *added = 0;
+      Node<Metric> *first = head.load(std::memory_order_acquire);
+      while (true) {
+        for (Node<Metric> *node = first; node; node = node->next_) {
+          if (node->name_ == name) {
+            delete added;
+            return node->metric_;
+          }
+        }
+        if (!added) {
+          added = new Node<Metric>(name);
+        }
+        added->next_ = first;
+        // On failure first is the new head, and the nodes added meanwhile are searched
+        if (head.compare_exchange_weak
+              (first, added, std::memory_order_release, std::memory_order_acquire)) {
+          return added->metric_;
+        }
+      }
+    }
+
+    template<class Metric> static void
+    deleteAll(std::atomic<Node<Metric> *>& head)
+    {
+      Node<Metric> *node = head.load(std::memory_order_acquire);
+      while (node) {
+        Node<Metric> *next = node->next_;
+        delete node;
+        node = next;
+      }
+    }
+
+    std::atomic<Node<Counter> *> counters_;
+    std::atomic<Node<Gauge> *> gauges_;
+    std::atomic<Node<Histogram> *> histograms_;
+  };
+}
+
+#endif
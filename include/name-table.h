@@ -0,0 +1,108 @@
+// NameTable interns the entity names EntityDiscovery and SyncBasedDiscovery keep,
+// so that each name is stored once and referred to by a small integer.
+
+#ifndef __ndnrtc__addon__name__table__
+#define __ndnrtc__addon__name__table__
+
+#include <ndn-cpp/ndn-cpp-config.h>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace entity_discovery
+{
+  /**
+   * NameTable gives each distinct name an Id, which stays valid until the last reference
+   * to the name is released, and then may be given to another name. The hash of each
+   * name is computed once, when it's interned; lookups compare names only when their
+   * hashes match.
+   */
+  class NameTable
+  {
+  public:
+    typedef uint32_t Id;
+
+    static const Id NONE = 0xFFFFFFFF;
+
+    NameTable();
+
+    /**
+     * Add a reference to name, interning it if it's new.
+     * @return The Id of name.
+     */
+    Id
+    intern(const std::string& name);
+
+    /**
+     * Add a reference to the name of id.
+     */
+    void
+    acquire(Id id) { ++entries_[id].refCount_; }
+
+    /**
+     * Drop a reference to the name of id, removing the name with its last reference.
+     */
+    void
+    release(Id id);
+
+    /**
+     * Return the Id of name, or NONE if it's not interned. This adds no reference.
+     */
+    Id
+    find(const char *name, size_t nameLength) const;
+
+    Id
+    find(const std::string& name) const { return find(name.data(), name.size()); }
+
+    const std::string&
+    get(Id id) const { return entries_[id].name_; }
+
+    uint64_t
+    getHash(Id id) const { return entries_[id].hash_; }
+
+    /**
+     * Return the number of names interned.
+     */
+    size_t
+    size() const { return size_; }
+
+    static uint64_t
+    hash(const char *name, size_t nameLength);
+
+  private:
+    class Entry {
+    public:
+      Entry()
+      : hash_(0), refCount_(0)
+      {}
+
+      std::string name_;
+      uint64_t hash_;
+      uint32_t refCount_;
+    };
+
+    // Marks an index slot whose Id was removed, which lookups probe past
+    static const Id REMOVED = 0xFFFFFFFE;
+
+    /**
+     * Return the index slot of name, or of the free slot where it belongs.
+     */
+    size_t
+    findSlot(const char *name, size_t nameLength, uint64_t hash) const;
+
+    void
+    resize(size_t slotCount);
+
+    // Interned names by Id; Ids of removed names are kept in freeIds_ for reuse
+    std::vector<Entry> entries_;
+    std::vector<Id> freeIds_;
+    // Open addressing index of Ids by hash, with linear probing; its size is a power of 2
+    std::vector<Id> slots_;
+    size_t size_;
+    // Slots holding an Id or REMOVED
+    size_t usedSlots_;
+  };
+}
+
+#endif
@@ -0,0 +1,235 @@
+// Scheduler runs delayed callbacks for Chat, EntityDiscovery and SyncBasedDiscovery,
+// from the same event loop that calls face.processEvents.
+
+#ifndef __ndnrtc__addon__scheduler__
+#define __ndnrtc__addon__scheduler__
+
+#include <ndn-cpp/ndn-cpp-config.h>
+#include <ndn-cpp/common.hpp>
+
+#include <sys/time.h>
+#include <cmath>
+#include <vector>
+
+namespace ndnrtc_addon
+{
+  /**
+   * Scheduler is a hierarchical timer wheel: LEVELS wheels of SLOTS slots each, where a
+   * slot of level 0 holds the events due in one tick, and a slot of level n the events
+   * due in SLOTS^n ticks. Scheduling and cancelling are O(1); as time advances, the
+   * events of a slot of level n are spread over the wheel below when it's reached, and
+   * the events of the current slot of level 0 are run.
+   *
+   * Nothing happens unless processEvents is called; call it as often as face.processEvents,
+   * and in the same thread.
+   */
+  class Scheduler
+  {
+  public:
+    typedef ndn::func_lib::function<void()> Callback;
+    typedef ndn::func_lib::function<ndn::MillisecondsSince1970()> Clock;
+
+    static const size_t SLOT_BITS = 6;
+    static const size_t SLOTS = 1 << SLOT_BITS;
+    static const size_t LEVELS = 4;
+
+  private:
+    class EventState {
+    public:
+      EventState()
+      : cancelled_(false), done_(false)
+      {}
+
+      bool cancelled_;
+      bool done_;
+    };
+
+  public:
+    /**
+     * An EventHandle cancels a scheduled event; a default constructed one refers to no event.
+     */
+    class EventHandle {
+    public:
+      EventHandle()
+      {}
+
+      /**
+       * Cancel the event, if it has not run yet.
+       */
+      void
+      cancel()
+      {
+        if (state_) {
+          state_->cancelled_ = true;
+        }
+      }
+
+      /**
+       * Check if the event is scheduled, and neither run nor cancelled yet.
+       */
+      bool
+      isPending() const
+      {
+        return state_ && !state_->cancelled_ && !state_->done_;
+      }
+
+    private:
+      friend class Scheduler;
+
+      EventHandle(const ndn::ptr_lib::shared_ptr<EventState>& state)
+      : state_(state)
+      {}
+
+      ndn::ptr_lib::shared_ptr<EventState> state_;
+    };
+
+    /**
+     * Constructor.
+     * @param tickMilliseconds The resolution of the scheduler: events run in the first
+     * processEvents after the end of the tick in which they are due.
+     * @param clock The clock returning the current time in milliseconds; gettimeofday
+     * if omitted. A simulation passes its virtual clock.
+     */
+    Scheduler(ndn::Milliseconds tickMilliseconds = 10, const Clock& clock = Clock())
+    : tickMilliseconds_(tickMilliseconds), clock_(clock), currentTick_(0), size_(0),
+      wheels_(LEVELS, std::vector<std::vector<Event> >(SLOTS))
+    {
+      if (!clock_) {
+        clock_ = &getSystemMilliseconds;
+      }
+      startTime_ = clock_();
+    }
+
+    /**
+     * Schedule callback to run delayMilliseconds from now.
+     * @return The handle for cancelling the event.
+     */
+    EventHandle
+    schedule(ndn::Milliseconds delayMilliseconds, const Callback& callback)
+    {
+      // Round up, so that events never run early
+      double tick = ::ceil((clock_() - startTime_ + delayMilliseconds) / tickMilliseconds_);
+      Event event;
+      event.tick_ = tick > (double)currentTick_ ? (uint64_t)tick : currentTick_;
+      event.callback_ = callback;
+      event.state_.reset(new EventState());
+
+      insert(event);
+      ++size_;
+      return EventHandle(event.state_);
+    }
+
+    /**
+     * Run the events due by now, in the order of their ticks.
+     */
+    void
+    processEvents()
+    {
+      double now = ::floor((clock_() - startTime_) / tickMilliseconds_);
+      if (now < (double)currentTick_) {
+        return;
+      }
+      uint64_t nowTick = (uint64_t)now;
+
+      while (currentTick_ <= nowTick) {
+        if (size_ == 0) {
+          // Nothing to cascade or run
+          currentTick_ = nowTick + 1;
+          break;
+        }
+        processTick();
+      }
+    }
+
+    /**
+     * Return the number of events held, including cancelled ones whose tick has not come yet.
+     */
+    size_t
+    size() const { return size_; }
+
+    ndn::MillisecondsSince1970
+    getNowMilliseconds() const { return clock_(); }
+
+  private:
+    class Event {
+    public:
+      uint64_t tick_;
+      Callback callback_;
+      ndn::ptr_lib::shared_ptr<EventState> state_;
+    };
+
+    static ndn::MillisecondsSince1970
+    getSystemMilliseconds()
+    {
+      struct timeval t;
+      gettimeofday(&t, 0);
+      return t.tv_sec * 1000.0 + t.tv_usec / 1000.0;
+    }
+
+    /**
+     * Put event in the lowest level whose wheel spans its tick from currentTick_.
+     */
+    void
+    insert(const Event& event)
+    {
+      uint64_t delta = event.tick_ - currentTick_;
+      for (size_t level = 0; level < LEVELS; ++level) {
+        if (delta < ((uint64_t)1 << (SLOT_BITS * (level + 1)))) {
+          wheels_[level][(event.tick_ >> (SLOT_BITS * level)) & (SLOTS - 1)].push_back(event);
+          return;
+        }
+      }
+      // Beyond the top wheel: park in the last slot it spans, processTick puts
+      // the event back when it's reached too early
+      uint64_t tick = currentTick_ + ((uint64_t)1 << (SLOT_BITS * LEVELS)) - 1;
+      wheels_[LEVELS - 1][(tick >> (SLOT_BITS * (LEVELS - 1))) & (SLOTS - 1)].push_back(event);
+    }
+
+    void
+    processTick()
+    {
+      uint64_t tick = currentTick_;
+
+      // At the start of a slot of level n, spread its events over the levels below
+      for (size_t level = 1; level < LEVELS; ++level) {
+        if (((tick >> (SLOT_BITS * (level - 1))) & (SLOTS - 1)) != 0) {
+          break;
+        }
+        std::vector<Event> events;
+        events.swap(wheels_[level][(tick >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+        for (size_t i = 0; i < events.size(); ++i) {
+          insert(events[i]);
+        }
+      }
+
+      // Events scheduled by the callbacks below go to later ticks
+      ++currentTick_;
+      std::vector<Event> events;
+      events.swap(wheels_[0][tick & (SLOTS - 1)]);
+      for (size_t i = 0; i < events.size(); ++i) {
+        Event& event = events[i];
+        if (event.state_->cancelled_) {
+          --size_;
+        }
+        else if (event.tick_ > tick) {
+          insert(event);
+        }
+        else {
+          --size_;
+          event.state_->done_ = true;
+          event.callback_();
+        }
+      }
+    }
+
+    ndn::Milliseconds tickMilliseconds_;
+    Clock clock_;
+    ndn::MillisecondsSince1970 startTime_;
+    // The next tick to process
+    uint64_t currentTick_;
+    size_t size_;
+    std::vector<std::vector<std::vector<Event> > > wheels_;
+  };
+}
+
+#endif
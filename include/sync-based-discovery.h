@@ -16,10 +16,25 @@
 // remove dependency on boost header for this.
 #include <boost/algorithm/string.hpp>
 
+#include <openssl/sha.h>
+
 #include <sys/time.h>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <queue>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <iostream>
 
 #include "external-observer.h"
+#include "sync-data-codec.h"
+#include "sync-iblt.h"
+#include "scheduler.h"
+#include "name-table.h"
+#include "metrics.h"
 
 namespace entity_discovery
 {
@@ -27,6 +42,21 @@ namespace entity_discovery
     (const std::vector<std::string>& syncData)>
       OnReceivedSyncData;
 
+  /**
+   * How the root digest of the object set is computed.
+   * SHA256_FULL hashes the concatenation of all sorted objects, which is what 
+   * older peers do; INCREMENTAL XORs together the SHA-256 of each object, so 
+   * that adding or removing an object updates the digest in O(1).
+   * Peers using different digest types never agree on a digest, they still
+   * interoperate by exchanging full state replies; switch to INCREMENTAL only 
+   * when every peer in the broadcast namespace supports it.
+   */
+  enum class SyncDigestType
+  {
+    SHA256_FULL,
+    INCREMENTAL
+  };
+
   static ndn::MillisecondsSince1970 
   ndn_getNowMilliseconds()
   {
@@ -61,17 +91,56 @@ namespace entity_discovery
      * and published objects will be appended directly after broadcast prefix
      * @param onReceivedSyncData The callback for the action after receiving sync data.
      * @param face The broadcast face.
+     * @param scheduler The scheduler for delaying the next sync interest, processed in the
+     * same thread as face.
      * @param keyChain The keychain to sign things with.
      * @param certificateName The certificate name for locating the certificate.
+     * @param digestType The way root digest is computed; defaults to SHA256_FULL, 
+     * which is compatible with older peers.
+     * @param digestLogLength The number of recent digests whose changes are kept, so
+     * that a peer a few steps behind is answered with a delta instead of the full
+     * object list. 0 disables the log; older peers do not understand delta replies, 
+     * so enable it only when every peer supports it.
+     * @param dataFormat The encoding of sync replies sent by this instance; replies
+     * of either encoding are understood. Older peers only understand TEXT.
+     * @param ibltCellCount The number of cells of the IBLT of objects_ carried in sync
+     * interests, from which the replying peer finds the objects we lack, so that the
+     * reply is as large as the difference rather than the object list. The table 
+     * lists differences of up to about 2/3 of its cells, larger ones are replied 
+     * with the full object list. Each cell takes 13 to 22 bytes of the interest name.
+     * 0 disables it; older peers ignore the IBLT and reply with the full object list.
+     * @param nameTable The table interning the names of objects, shared with the user so
+     * that names both keep are stored once; a table of its own if omitted.
+     * @param metrics The registry of the sync.* metrics, shared with the user so that
+     * the host reads them in one snapshot; a registry of its own if omitted.
      */
     SyncBasedDiscovery
       (ndn::Name broadcastPrefix, const OnReceivedSyncData& onReceivedSyncData, 
-       ndn::Face& face, ndn::KeyChain& keyChain, ndn::Name certificateName)
-     : broadcastPrefix_(broadcastPrefix), onReceivedSyncData_(onReceivedSyncData), 
-       face_(face), keyChain_(keyChain), certificateName_(certificateName), 
-       contentCache_(&face), newComerDigest_("00"), currentDigest_(newComerDigest_),
-       defaultDataFreshnessPeriod_(2000), defaultInterestLifetime_(2000), enabled_(true)
+       ndn::Face& face, ndnrtc_addon::Scheduler& scheduler, ndn::KeyChain& keyChain, 
+       ndn::Name certificateName, SyncDigestType digestType = SyncDigestType::SHA256_FULL, size_t digestLogLength = 0,
+       SyncDataFormat dataFormat = SyncDataFormat::TEXT, size_t ibltCellCount = 0,
+       ndn::ptr_lib::shared_ptr<NameTable> nameTable = ndn::ptr_lib::shared_ptr<NameTable>(),
+       ndn::ptr_lib::shared_ptr<ndnrtc_addon::MetricsRegistry> metrics = 
+         ndn::ptr_lib::shared_ptr<ndnrtc_addon::MetricsRegistry>())
+     : newComerDigest_("00"),
+       defaultDataFreshnessPeriod_(2000), defaultInterestLifetime_(2000), digestChangeDelay_(100),
+       maxSegmentSize_(6000), segmentFetchWindow_(8), maxSegmentRetries_(3), 
+       maxReplyCacheSize_(64),
+       broadcastPrefix_(broadcastPrefix), certificateName_(certificateName), 
+       onReceivedSyncData_(onReceivedSyncData), face_(face), scheduler_(scheduler), 
+       contentCache_(&face), keyChain_(keyChain), currentDigest_(newComerDigest_), enabled_(true),
+       digestType_(digestType), digestLogLength_(digestLogLength), dataFormat_(dataFormat),
+       ibltCellCount_(ibltCellCount), iblt_(ibltCellCount), broadcastInterestId_(0),
+       pendingInterestTable_(broadcastPrefix.size() + 1),
+       nameTable_(nameTable ? nameTable : ndn::ptr_lib::make_shared<NameTable>()),
+       metrics_(metrics ? metrics : ndn::ptr_lib::make_shared<ndnrtc_addon::MetricsRegistry>()),
+       interestsSent_(metrics_->getCounter("sync.interests_sent")),
+       interestsReceived_(metrics_->getCounter("sync.interests_received")),
+       dataSigned_(metrics_->getCounter("sync.data_signed")),
+       digestRecomputations_(metrics_->getCounter("sync.digest_recomputations")),
+       pitSize_(metrics_->getGauge("sync.pit_size"))
     {
+      memset(digestAccumulator_, 0, sizeof(digestAccumulator_));
     }
     
     void start()
@@ -86,9 +155,10 @@ namespace entity_discovery
       interest.setInterestLifetimeMilliseconds(defaultInterestLifetime_);
       interest.setMustBeFresh(true);
       
-      face_.expressInterest
+      broadcastInterestId_ = face_.expressInterest
         (interest, bind(&SyncBasedDiscovery::onData, shared_from_this(), _1, _2),
          bind(&SyncBasedDiscovery::onTimeout, shared_from_this(), _1));    
+      interestsSent_.increment();
     }
     
     /**
@@ -97,6 +167,10 @@ namespace entity_discovery
      */
     ~SyncBasedDiscovery()
     {
+      // The name table may outlive this
+      for (size_t i = 0; i < objects_.size(); ++i) {
+        nameTable_->release(objects_[i]);
+      }
     }
     
     /**
@@ -110,11 +184,17 @@ namespace entity_discovery
     {
       contentCache_.unregisterAll(); 
       enabled_ = false;
+      
+      broadcastEvent_.cancel();
+      face_.removePendingInterest(broadcastInterestId_);
     }
     
     /**
-     * onData sorts both the object(string) array received, 
-     * and the string array belonging to this object.
+     * onData diffs the object(string) array received against objects_.
+     * objects_ is always sorted; the received array is only sorted if the 
+     * sender did not send it in order.
+     * A segment of a segmented reply, whichever one a cache answered with, starts
+     * the fetch of the other segments instead.
      * A lock for objects_ member?
      */
     void onData
@@ -123,11 +203,31 @@ namespace entity_discovery
       
     void onTimeout
       (const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest);
-      
-    void dummyOnData
+    
+    /**
+     * onSegmentData stores a segment of a segmented sync reply, and expresses 
+     * interest for the next segment not yet requested, keeping up to segmentFetchWindow_ 
+     * segment interests outstanding. When every segment has arrived, and their content
+     * has the digest in their name, the reassembled content is handled like an 
+     * unsegmented reply. A segment of another reply abandons the fetch, and a new 
+     * broadcast interest is expressed.
+     */
+    void onSegmentData
       (const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest,
        const ndn::ptr_lib::shared_ptr<ndn::Data>& data);
-       
+    
+    /**
+     * onSegmentTimeout re-expresses the segment interest up to maxSegmentRetries_ times,
+     * after which the fetch is abandoned and a new broadcast interest is expressed.
+     */
+    void onSegmentTimeout
+      (const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest);
+      
+    /**
+     * expressBroadcastInterest expresses the sync interest for currentDigest_, in place 
+     * of the one outstanding, so that publishing, timeouts and replies never add a 
+     * second chain of broadcast interests.
+     */
     void expressBroadcastInterest
       (const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest);
     
@@ -158,34 +258,98 @@ namespace entity_discovery
      */
     void publishObject(std::string name);
     
+    /**
+     * Publish names in bulk, as publishObject does one by one, with one digest 
+     * recomputation, one cached reply for the old digest and one sync interest.
+     * @return The number of names that were not published already.
+     */
+    size_t publishObjects(const std::vector<std::string>& names);
+    
     /**
      * Called when stopConferencePublishing
      */
     int stopPublishingObject(std::string name);
     
     /**
-     * Updates the currentDigest_ according to the list of objects
+     * Stop publishing names in bulk, with one digest recomputation.
+     * @return The number of names removed.
+     */
+    size_t stopPublishingObjects(const std::vector<std::string>& names);
+    
+    /**
+     * Updates the currentDigest_ according to the list of objects.
+     * For SyncDigestType::INCREMENTAL this only encodes the accumulator, which 
+     * addObject and removeObject keep up to date.
      */
     void stringHash();
     void recomputeDigest();
     
+    SyncDigestType getDigestType() { return digestType_; }
+    
+    /**
+     * Return the number of received sync interests aggregated with a pending interest
+     * of the same name and face, and so answered along with it.
+     */
+    uint64_t getAggregatedInterestCount() { return pendingInterestTable_.getAggregatedCount(); }
+    
+    /**
+     * Return the number of times recomputeDigest was called.
+     */
+    uint64_t getDigestRecomputeCount() { return digestRecomputations_.get(); }
+    
+    ndn::ptr_lib::shared_ptr<ndnrtc_addon::MetricsRegistry> getMetrics() { return metrics_; }
+    
     const std::string newComerDigest_;
     const ndn::Milliseconds defaultDataFreshnessPeriod_;
     const ndn::Milliseconds defaultInterestLifetime_;
+    // The delay before the broadcast interest for a changed digest replaces the 
+    // outstanding one, which gathers the changes of one sync reply in one interest
+    const ndn::Milliseconds digestChangeDelay_;
+    
+    // Sync replies with content larger than this are split into segments
+    const size_t maxSegmentSize_;
+    // Number of segment interests kept outstanding when fetching a segmented reply
+    const size_t segmentFetchWindow_;
+    const int maxSegmentRetries_;
+    // Number of signed sync replies kept until objects_ changes
+    const size_t maxReplyCacheSize_;
     
     /**
      * These functions should be replaced, once we replace objects with something more
      * generic
      */
-    std::vector<std::string> getObjects() { return objects_; };
+    std::vector<std::string> getObjects()
+    {
+      std::vector<std::string> objects;
+      for (size_t i = 0; i < objects_.size(); ++i) {
+        objects.push_back(nameTable_->get(objects_[i]));
+      }
+      return objects;
+    };
     
     // addObject does not necessarily call updateHash
     int addObject(std::string object, bool updateDigest) {
-      std::vector<std::string>::iterator item = std::find(objects_.begin(), objects_.end(), object);
-      if (item == objects_.end() && object != "") {
-        objects_.push_back(object);
-        // Using default comparison '<' here
-        std::sort(objects_.begin(), objects_.end()); 
+      if (object == "") {
+        return 0;
+      }
+      // objects_ is kept sorted, so the insertion point is found with binary search
+      std::vector<NameTable::Id>::iterator item = std::lower_bound
+        (objects_.begin(), objects_.end(), object, ObjectLess(*nameTable_));
+      if (item == objects_.end() || nameTable_->get(*item) != object) {
+        NameTable::Id id = nameTable_->intern(object);
+        objects_.insert(item, id);
+        if (digestType_ == SyncDigestType::INCREMENTAL) {
+          updateDigestAccumulator(object);
+        }
+        if (digestLogLength_ > 0) {
+          recordPendingChange(object, true);
+        }
+        if (ibltCellCount_ > 0) {
+          uint64_t key = SyncIblt::getKey(object);
+          iblt_.insert(key);
+          ibltKeys_[key] = id;
+        }
+        clearReplyCache();
         // Update the currentDigest_ 
         if (updateDigest) {
           recomputeDigest();
@@ -193,17 +357,32 @@ namespace entity_discovery
         return 1;
       }
       else {
-        // The to be added string exists or is empty
+        // The to be added string exists
         return 0;
       }
     };
     
     // removeObject does not necessarily call updateHash
     int removeObject(std::string object, bool updateDigest) {
-      std::vector<std::string>::iterator item = std::find(objects_.begin(), objects_.end(), object);
-      if (item != objects_.end()) {
-        // I should not need to sort the thing again, if it's just erase. Remains to be tested
+      std::vector<NameTable::Id>::iterator item = std::lower_bound
+        (objects_.begin(), objects_.end(), object, ObjectLess(*nameTable_));
+      if (item != objects_.end() && nameTable_->get(*item) == object) {
+        NameTable::Id id = *item;
+        // Erasing keeps objects_ sorted
         objects_.erase(item);
+        nameTable_->release(id);
+        if (digestType_ == SyncDigestType::INCREMENTAL) {
+          updateDigestAccumulator(object);
+        }
+        if (digestLogLength_ > 0) {
+          recordPendingChange(object, false);
+        }
+        if (ibltCellCount_ > 0) {
+          uint64_t key = SyncIblt::getKey(object);
+          iblt_.erase(key);
+          ibltKeys_.erase(key);
+        }
+        clearReplyCache();
         // Update the currentDigest_
         if (updateDigest) {
           recomputeDigest();
@@ -215,17 +394,38 @@ namespace entity_discovery
       }
     };
     
+    bool hasObject(const std::string& object) {
+      return std::binary_search(objects_.begin(), objects_.end(), object, ObjectLess(*nameTable_));
+    }
+    
     // To and from string method using \n as splitter
     std::string 
     objectsToString() {
       std::string result;
-      for(std::vector<std::string>::iterator it = objects_.begin(); it != objects_.end(); ++it) {
-        result += *it;
+      for(std::vector<NameTable::Id>::iterator it = objects_.begin(); it != objects_.end(); ++it) {
+        result += nameTable_->get(*it);
         result += "\n";
       }
       return result;
     }
     
+    /**
+     * Builds the entries replied to a peer whose digest is fromDigest: 
+     * the changes since fromDigest if it's in the digest log, otherwise every object.
+     */
+    std::vector<SyncDataCodec::Entry>
+    syncEntriesSince(const std::string& fromDigest);
+    
+    /**
+     * Builds the entries replied to the sync interest named name (without segment number).
+     * If name carries an IBLT after the digest, these are the objects the requester
+     * lacks, as found by subtracting the IBLT from ours; otherwise, or if the 
+     * difference can't be listed or names none of our objects, they are 
+     * syncEntriesSince the digest.
+     */
+    std::vector<SyncDataCodec::Entry>
+    syncEntriesFor(const ndn::Name& name);
+    
     static std::vector<std::string> stringToObjects(std::string str) {
       std::vector<std::string> objects;
       boost::split(objects, str, boost::is_any_of("\n"));
@@ -240,6 +440,79 @@ namespace entity_discovery
      * Should-be-replaced methods end
      */
     
+    /**
+     * Encode entries into Data packets named name, signed and ready to be sent.
+     * Content that fits in maxSegmentSize_ is put in a single Data named name, like
+     * older peers do; otherwise, each segment is named name + the digest of the whole
+     * reply + segment number, and carries the last segment number as FinalBlockId. The
+     * digest ties the segments to the reply they were cut from, so that a requester
+     * fetching them never mixes segments of two replies to the same name, such as a
+     * delta and a full list, or TEXT and BINARY ones. Segments are cut at entry boundaries, 
+     * so that each of them can be decoded on its own.
+     */
+    std::vector<ndn::ptr_lib::shared_ptr<ndn::Data> >
+    makeSyncData(const ndn::Name& name, const std::vector<SyncDataCodec::Entry>& entries);
+    
+    /**
+     * After names were published, cache the reply to peers still at oldDigest and 
+     * express the sync interest for the new digest.
+     */
+    void
+    onPublished(const std::string& oldDigest);
+    
+    /**
+     * ObjectLess orders the Ids of objects_ by their names, for searching objects_
+     * with a name.
+     */
+    class ObjectLess {
+    public:
+      ObjectLess(const NameTable& nameTable)
+      : nameTable_(nameTable)
+      {}
+      
+      bool
+      operator()(NameTable::Id object, const std::string& name) const 
+      {
+        return nameTable_.get(object) < name;
+      }
+      
+      bool
+      operator()(const std::string& name, NameTable::Id object) const 
+      {
+        return name < nameTable_.get(object);
+      }
+      
+    private:
+      const NameTable& nameTable_;
+    };
+    
+    /**
+     * A DigestLogEntry records the objects added and removed when the root digest
+     * changed from digest_ to the digest of the next entry (or currentDigest_).
+     */
+    class DigestLogEntry {
+    public:
+      DigestLogEntry
+        (const std::string& digest, const std::vector<std::string>& added, 
+         const std::vector<std::string>& removed)
+      : digest_(digest), added_(added), removed_(removed)
+      {}
+      
+      const std::string&
+      getDigest() const { return digest_; }
+      
+      const std::vector<std::string>&
+      getAdded() const { return added_; }
+      
+      const std::vector<std::string>&
+      getRemoved() const { return removed_; }
+      
+    private:
+      std::string digest_;
+      std::vector<std::string> added_;
+      std::vector<std::string> removed_;
+    };
+    
     /**
      * PendingInterest class copied from ChronoSync2013 cpp implementation
      *
@@ -255,10 +528,11 @@ namespace entity_discovery
        * @param transport The transport from the onInterest callback. If the
        * interest is satisfied later by a new data packet, we will send the data
        * packet to the transport.
+       * @param nowMilliseconds The current time in milliseconds, from the scheduler's clock.
        */
       PendingInterest
         (const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest,
-         ndn::Face& face);
+         ndn::Face& face, ndn::MillisecondsSince1970 nowMilliseconds);
 
       /**
        * Return the interest given to the constructor.
@@ -274,7 +548,7 @@ namespace entity_discovery
 
       /**
        * Check if this interest is timed out.
-       * @param nowMilliseconds The current time in milliseconds from ndn_getNowMilliseconds.
+       * @param nowMilliseconds The current time in milliseconds from the scheduler's clock.
        * @return true if this interest timed out, otherwise false.
        */
       bool
@@ -282,22 +556,226 @@ namespace entity_discovery
       {
         return timeoutTimeMilliseconds_ >= 0.0 && nowMilliseconds >= timeoutTimeMilliseconds_;
       }
+      
+      /**
+       * Return the time when the interest times out, or -1 for no timeout.
+       */
+      ndn::MillisecondsSince1970
+      getTimeoutTimeMilliseconds() { return timeoutTimeMilliseconds_; }
 
     private:
       ndn::ptr_lib::shared_ptr<const ndn::Interest> interest_;
       ndn::Face& face_;
       ndn::MillisecondsSince1970 timeoutTimeMilliseconds_; /**< The time when the
-        * interest times out in milliseconds according to ndn_getNowMilliseconds,
+        * interest times out in milliseconds according to the scheduler's clock,
         * or -1 for no timeout. */
     };
     
+    /**
+     * A PendingInterestTable holds PendingInterests indexed by the first keyLength 
+     * components of their name, so that the ones a data packet may satisfy are found
+     * without looking at the others. Timed out interests are removed in order of their
+     * timeout, whenever interests are added or extracted.
+     * Interests with the same name from the same face are aggregated into one entry, 
+     * which is answered once, like a forwarder does.
+     */
+    class PendingInterestTable {
+    public:
+      /**
+       * @param keyLength The number of name components pending interests are indexed by; 
+       * data names shorter than this satisfy no pending interest.
+       */
+      PendingInterestTable(size_t keyLength)
+      : keyLength_(keyLength), nextId_(0), size_(0), aggregatedCount_(0)
+      {}
+      
+      /**
+       * Add pendingInterest, unless an interest with the same name and nonce is already
+       * pending, which is the same interest received again. If an interest with the 
+       * same name from the same face is pending, pendingInterest is aggregated with it:
+       * the entry keeps whichever times out later.
+       * @return false if pendingInterest is a duplicate and was not added.
+       */
+      bool
+      add
+        (const ndn::ptr_lib::shared_ptr<PendingInterest>& pendingInterest,
+         ndn::MillisecondsSince1970 nowMilliseconds);
+      
+      /**
+       * Remove the pending interests that the data named dataName satisfies, and 
+       * append them to matched.
+       */
+      void
+      extractMatching
+        (const ndn::Name& dataName, ndn::MillisecondsSince1970 nowMilliseconds,
+         std::vector<ndn::ptr_lib::shared_ptr<PendingInterest> >& matched);
+      
+      /**
+       * Remove every pending interest whose name starts with prefix, which has 
+       * keyLength components, and append them to matched.
+       */
+      void
+      extract
+        (const ndn::Name& prefix, ndn::MillisecondsSince1970 nowMilliseconds,
+         std::vector<ndn::ptr_lib::shared_ptr<PendingInterest> >& matched);
+      
+      void
+      removeExpired(ndn::MillisecondsSince1970 nowMilliseconds);
+      
+      /**
+       * Return the number of entries, with aggregated interests counted once.
+       */
+      size_t
+      size() const { return size_; }
+      
+      /**
+       * Return the number of interests aggregated with an entry since construction.
+       */
+      uint64_t
+      getAggregatedCount() const { return aggregatedCount_; }
+      
+    private:
+      /**
+       * An entry holds the latest of the interests aggregated into it, and the
+       * keys of all of them.
+       */
+      class Entry {
+      public:
+        Entry(const ndn::ptr_lib::shared_ptr<PendingInterest>& pendingInterest,
+              const std::string& aggregateKey)
+        : pendingInterest_(pendingInterest), aggregateKey_(aggregateKey)
+        {}
+        
+        ndn::ptr_lib::shared_ptr<PendingInterest> pendingInterest_;
+        std::string aggregateKey_;
+        std::vector<std::string> duplicateKeys_;
+      };
+      
+      typedef std::map<uint64_t, Entry> Bucket;
+      
+      /**
+       * The timeout of the entry id_ in the bucket key_; it's ignored if the entry
+       * was extracted, or had a later interest aggregated, before the timeout.
+       */
+      class Expiry {
+      public:
+        Expiry(ndn::MillisecondsSince1970 time, uint64_t id, const std::string& key)
+        : time_(time), id_(id), key_(key)
+        {}
+        
+        bool
+        operator > (const Expiry& other) const { return time_ > other.time_; }
+        
+        ndn::MillisecondsSince1970 time_;
+        uint64_t id_;
+        std::string key_;
+      };
+      
+      std::string
+      getKey(const ndn::Name& name);
+      
+      static std::string
+      getDuplicateKey(const ndn::Interest& interest);
+      
+      static std::string
+      getAggregateKey(PendingInterest& pendingInterest);
+      
+      void
+      erase(Bucket& bucket, Bucket::iterator item);
+      
+      size_t keyLength_;
+      uint64_t nextId_;
+      size_t size_;
+      uint64_t aggregatedCount_;
+      std::unordered_map<std::string, Bucket> buckets_;
+      // Name and nonce of the pending interests that have a nonce
+      std::unordered_set<std::string> duplicateKeys_;
+      // The entry id of each pending name and face
+      std::unordered_map<std::string, uint64_t> aggregateKeys_;
+      std::priority_queue<Expiry, std::vector<Expiry>, std::greater<Expiry> > expiries_;
+    };
+    
   private:
+    /**
+     * XOR the SHA-256 of object into digestAccumulator_. Since XOR is its own 
+     * inverse, the same call is used for both adding and removing an object.
+     */
+    void updateDigestAccumulator(const std::string& object);
+    
+    /**
+     * Record an object change that's not yet reflected in currentDigest_.
+     * Adding and then removing the same object (or vice versa) cancels out.
+     */
+    void recordPendingChange(const std::string& object, bool added);
+    
+    /**
+     * Diff the content of all segments of a sync reply against objects_, 
+     * notify onReceivedSyncData_, and express the next broadcast interest after a while.
+     */
+    void processSyncContent(const std::vector<ndn::Blob>& segments);
+    
+    void expressSegmentInterest(const ndn::Name& baseName, uint64_t segment);
+    
+    /**
+     * Get the signed segments replied to the sync interest named name (without 
+     * segment number). Replies are cached until
+     * objects_ changes, since until then every interest with the same name gets the same
+     * reply; Data keeps its wire encoding, so they are also encoded only once.
+     */
+    std::vector<ndn::ptr_lib::shared_ptr<ndn::Data> >
+    getSyncReply(const ndn::Name& name);
+    
+    void
+    clearReplyCache()
+    {
+      replyCache_.clear();
+      replyCacheOrder_.clear();
+    }
+    
+    /**
+     * The name of our sync interest: broadcastPrefix_, currentDigest_, and our IBLT
+     * if enabled and we know any object.
+     */
+    ndn::Name getBroadcastInterestName();
+    
+    /**
+     * Reply to the pending interests for digest that carry an IBLT, which the reply
+     * named with digest alone does not satisfy.
+     */
+    void satisfyPendingIbltInterests(const std::string& digest);
+    
+    /**
+     * A SegmentFetch holds the segments of a segmented sync reply received so far.
+     */
+    class SegmentFetch {
+    public:
+      SegmentFetch(uint64_t finalSegment)
+      : segments_(finalSegment + 1), received_(finalSegment + 1, false), 
+        receivedCount_(0), nextSegment_(0)
+      {}
+      
+      std::vector<ndn::Blob> segments_;
+      std::vector<bool> received_;
+      size_t receivedCount_;
+      // The next segment to express interest for, unless it was received
+      uint64_t nextSegment_;
+      // Retries of each outstanding segment
+      std::map<uint64_t, int> retries_;
+    };
+    
+    /**
+     * Set currentDigest_, logging the pending changes under the old digest if 
+     * the digest log is enabled.
+     */
+    void setCurrentDigest(const std::string& digest);
+    
     ndn::Name broadcastPrefix_;
     ndn::Name certificateName_;
     
     OnReceivedSyncData onReceivedSyncData_;
     
     ndn::Face& face_;
+    ndnrtc_addon::Scheduler& scheduler_;
     ndn::MemoryContentCache contentCache_;
     
     ndn::KeyChain& keyChain_;
@@ -309,10 +787,53 @@ namespace entity_discovery
     // This serves as the list of objects to be synchronized. 
     // For now, it's the list of full conference names (prefix + conferenceName)
     // Could be replaced with a Protobuf class or a class later.
-    std::vector<std::string> objects_;
+    // It is a flat sorted set: addObject and removeObject keep it sorted with binary search, 
+    // so that objectsToString and the diff in onData never need to sort it.
+    // It holds the Ids of the names in nameTable_, each with a reference, ordered by name.
+    std::vector<NameTable::Id> objects_;
+    
+    SyncDigestType digestType_;
+    // XOR of per-object SHA-256 digests, maintained only for SyncDigestType::INCREMENTAL.
+    uint8_t digestAccumulator_[SHA256_DIGEST_LENGTH];
+    
+    // Bounded log of recent digests and the changes made since each of them, oldest first.
+    size_t digestLogLength_;
+    
+    SyncDataFormat dataFormat_;
+    
+    // IBLT of objects_ keys, and the object of each key, maintained only if ibltCellCount_ > 0.
+    size_t ibltCellCount_;
+    SyncIblt iblt_;
+    std::map<uint64_t, NameTable::Id> ibltKeys_;
+    
+    std::deque<DigestLogEntry> digestLog_;
+    // Changes since currentDigest_ was last computed; true for added, false for removed.
+    std::map<std::string, bool> pendingChanges_;
+    
+    // Signed sync replies by interest name, and the names in the order they were added
+    std::unordered_map<std::string, std::vector<ndn::ptr_lib::shared_ptr<ndn::Data> > > replyCache_;
+    std::deque<std::string> replyCacheOrder_;
+    
+    // Segmented sync replies being fetched, by the name of their segments without 
+    // segment number
+    std::map<std::string, SegmentFetch> segmentFetches_;
+    
+    // The one outstanding broadcast interest, and the scheduled expression of the next
+    uint64_t broadcastInterestId_;
+    ndnrtc_addon::Scheduler::EventHandle broadcastEvent_;
+    
+    // PendingInterestTable for holding outstanding interests, indexed by broadcastPrefix_ and digest.
+    PendingInterestTable pendingInterestTable_;
+    
+    ndn::ptr_lib::shared_ptr<NameTable> nameTable_;
     
-    // PendingInterestTable for holding outstanding interests.
-    std::vector<ndn::ptr_lib::shared_ptr<PendingInterest> > pendingInterestTable_;
+    ndn::ptr_lib::shared_ptr<ndnrtc_addon::MetricsRegistry> metrics_;
+    ndnrtc_addon::Counter& interestsSent_;
+    ndnrtc_addon::Counter& interestsReceived_;
+    ndnrtc_addon::Counter& dataSigned_;
+    ndnrtc_addon::Counter& digestRecomputations_;
+    // The size of pendingInterestTable_, as of its last change here
+    ndnrtc_addon::Gauge& pitSize_;
   };
 }
 
@@ -0,0 +1,106 @@
+// SyncDataCodec encodes and decodes the content of SyncBasedDiscovery sync replies:
+// lists of objects (full state), or of objects added and removed (delta).
+
+#ifndef __ndnrtc__addon__sync__data__codec__
+#define __ndnrtc__addon__sync__data__codec__
+
+#include <ndn-cpp/ndn-cpp-config.h>
+#include <ndn-cpp/util/blob.hpp>
+
+#include <string>
+#include <vector>
+
+namespace entity_discovery
+{
+  /**
+   * The encoding of sync reply content.
+   * TEXT is what older peers send and understand: one object name URI per line,
+   * with '+' or '-' before each name of a delta.
+   * BINARY is a versioned, length-prefixed encoding in which each name only carries
+   * the suffix that differs from the name before it.
+   * Decoding detects the encoding, so peers may choose different ones as long as every
+   * peer decodes BINARY.
+   */
+  enum class SyncDataFormat
+  {
+    TEXT,
+    BINARY
+  };
+
+  class SyncDataCodec
+  {
+  public:
+    enum EntryType
+    {
+      OBJECT = 0,     // An object in a full state list
+      ADDED = 1,      // An object added since the requester's digest
+      REMOVED = 2     // An object removed since the requester's digest
+    };
+
+    class Entry
+    {
+    public:
+      Entry(EntryType type, const std::string& name)
+      : type_(type), name_(name)
+      {}
+
+      EntryType type_;
+      std::string name_;
+    };
+
+    /**
+     * Called for each decoded entry. The name is not null terminated, and only
+     * valid during the call: it points either into the decoded buffer, or into a
+     * buffer reused by the decoder for rebuilding prefix compressed names.
+     */
+    typedef ndn::func_lib::function<void
+      (EntryType type, const char *name, size_t nameLength)>
+        OnEntry;
+
+    static const uint8_t BINARY_MAGIC = 0xDC;
+    static const uint8_t BINARY_VERSION = 1;
+
+    /**
+     * Encode entries starting from begin into output, stopping before the encoding
+     * grows larger than maxSize; at least one entry is encoded, even if it alone
+     * is larger than maxSize. The output can be decoded on its own.
+     * @return The index of the first entry not encoded.
+     */
+    static size_t
+    encode
+      (SyncDataFormat format, const std::vector<Entry>& entries, size_t begin,
+       size_t maxSize, std::string& output);
+
+    /**
+     * Decode buf of either format, calling onEntry for each entry, in encoding order.
+     * No copy of buf is made: TEXT names, and BINARY names that share no prefix with
+     * the name before them, point into buf directly.
+     * @return false if buf is malformed, in which case onEntry may have been
+     * called for the entries before the malformed one.
+     */
+    static bool
+    decode(const uint8_t *buf, size_t size, const OnEntry& onEntry);
+
+    static bool
+    decode(const ndn::Blob& blob, const OnEntry& onEntry)
+    {
+      return decode(blob.buf(), blob.size(), onEntry);
+    }
+
+    /**
+     * Append value in 7 bit groups, least significant first; the high bit marks
+     * that more groups follow. SyncIblt uses the same numbers.
+     */
+    static void
+    encodeVarNumber(uint64_t value, std::string& output);
+
+    /**
+     * Decode a number appended by encodeVarNumber at buf, advancing buf past it.
+     * @return false if the number runs past end or doesn't fit in 64 bits.
+     */
+    static bool
+    decodeVarNumber(const uint8_t *& buf, const uint8_t *end, uint64_t& value);
+  };
+}
+
+#endif
@@ -0,0 +1,123 @@
+// SyncIblt is an invertible Bloom lookup table of object name hashes, which
+// SyncBasedDiscovery peers exchange to find the difference of their object sets.
+
+#ifndef __ndnrtc__addon__sync__iblt__
+#define __ndnrtc__addon__sync__iblt__
+
+#include <ndn-cpp/ndn-cpp-config.h>
+#include <ndn-cpp/util/blob.hpp>
+
+#include <string>
+#include <vector>
+
+namespace entity_discovery
+{
+  /**
+   * An invertible Bloom lookup table (IBLT) of 64-bit keys.
+   * Subtracting the table of one set from the table of another gives a table of
+   * their symmetric difference, which can be listed as long as the difference is
+   * small compared with the number of cells (about 2/3 of it), regardless of the
+   * size of the sets.
+   */
+  class SyncIblt
+  {
+  public:
+    // Each key is added to one cell in each of HASH_COUNT equal partitions of the table
+    static const size_t HASH_COUNT = 3;
+
+    // The first byte of the encoding; never 0x00, so that an encoded table in a name
+    // component can't be mistaken for a segment number
+    static const uint8_t MAGIC = 0xB1;
+    static const uint8_t VERSION = 1;
+
+    /**
+     * Create an empty table.
+     * @param cellCount The number of cells, rounded up to a multiple of HASH_COUNT.
+     */
+    SyncIblt(size_t cellCount = 0);
+
+    /**
+     * Get the key of an object name: the first 8 bytes of its SHA-256.
+     */
+    static uint64_t
+    getKey(const std::string& name);
+
+    void
+    insert(uint64_t key) { update(key, 1); }
+
+    void
+    erase(uint64_t key) { update(key, -1); }
+
+    size_t
+    getCellCount() const { return cells_.size(); }
+
+    /**
+     * Subtract other from this table, cell by cell; both must have the same cell count.
+     */
+    void
+    subtract(const SyncIblt& other);
+
+    /**
+     * List the keys of the table by peeling cells that hold a single key.
+     * After subtract, positive gets the keys only in this table, and negative the
+     * keys only in the subtracted table. The table itself is left unchanged.
+     * @return false if some keys could not be listed, because the difference
+     * is too large for the table.
+     */
+    bool
+    listEntries(std::vector<uint64_t>& positive, std::vector<uint64_t>& negative) const;
+
+    /**
+     * Encode as MAGIC, VERSION, the cell count and then each cell.
+     */
+    ndn::Blob
+    encode() const;
+
+    /**
+     * Decode buf into result.
+     * @return false if buf is not an encoded table, or one without cells.
+     */
+    static bool
+    decode(const uint8_t *buf, size_t size, SyncIblt& result);
+
+    static bool
+    decode(const ndn::Blob& blob, SyncIblt& result)
+    {
+      return decode(blob.buf(), blob.size(), result);
+    }
+
+  private:
+    class Cell {
+    public:
+      Cell()
+      : count_(0), keySum_(0), hashSum_(0)
+      {}
+
+      bool
+      isPure() const
+      {
+        return (count_ == 1 || count_ == -1) && hashSum_ == checkHash(keySum_);
+      }
+
+      bool
+      isEmpty() const { return count_ == 0 && keySum_ == 0 && hashSum_ == 0; }
+
+      int64_t count_;
+      uint64_t keySum_;
+      uint32_t hashSum_;
+    };
+
+    void
+    update(uint64_t key, int64_t count);
+
+    size_t
+    getCellIndex(uint64_t key, size_t i) const;
+
+    static uint32_t
+    checkHash(uint64_t key);
+
+    std::vector<Cell> cells_;
+  };
+}
+
+#endif
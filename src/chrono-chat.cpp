@@ -24,11 +24,8 @@ Chat::initial()
   if (!enabled_)
     return;
     
-  // Set the heartbeat timeout using the Interest timeout mechanism. The
-  // heartbeat() function will call itself again after a timeout.
-  Interest timeout("/local/timeout");
-  timeout.setInterestLifetimeMilliseconds(heartbeatInterval_);
-  faceProcessor_.expressInterest(timeout, dummyOnData, bind(&Chat::heartbeat, shared_from_this(), _1));
+  // Schedule the heartbeat. The heartbeat() function will schedule itself again.
+  scheduler_.schedule(heartbeatInterval_, bind(&Chat::heartbeat, shared_from_this()));
 
   if (find(roster_.begin(), roster_.end(), usrname_) == roster_.end()) {
     roster_.push_back(usrname_);
@@ -106,6 +103,7 @@ Chat::sendInterest
       faceProcessor_.expressInterest
         (interest, bind(&Chat::onData, shared_from_this(), _1, _2),
          bind(&Chat::chatTimeout, shared_from_this(), _1));
+      interestsSent_.increment();
     }
     
     syncTreeStatus_[uri.str()] = seqlist[i];
@@ -120,6 +118,7 @@ Chat::onInterestCallback
 {
   if (!enabled_)
     return ;
+  interestsReceived_.increment();
   SyncDemo::ChatMessage content;
   int seq = ::atoi(inst->getName().get(chat_prefix_.size() + 1).toEscapedString().c_str());
   for (int i = msgcache_.size() - 1; i >= 0; --i) {
@@ -149,6 +148,7 @@ Chat::onInterestCallback
     
     data.setContent(Blob(array, false));
     keyChain_.sign(data, certificateName_);
+    dataSigned_.increment();
     try {
       //transport.send(*co.wireEncode());
       face.putData(data);
@@ -210,12 +210,10 @@ Chat::onData
   }
   */
   
-  // Set the alive timeout using the Interest timeout mechanism.
-  Interest timeout("/local/timeout");
-  timeout.setInterestLifetimeMilliseconds(checkAliveWaitPeriod_);
-  faceProcessor_.expressInterest
-    (timeout, dummyOnData,
-     bind(&Chat::alive, shared_from_this(), _1, seqno, name, session, prefix));
+  // Schedule the alive check.
+  scheduler_.schedule
+    (checkAliveWaitPeriod_,
+     bind(&Chat::alive, shared_from_this(), seqno, name, session, prefix));
 
   // isRecoverySyncState_ was set by sendInterest.
   // TODO: If isRecoverySyncState_ changed, this assumes that we won't get
@@ -249,7 +247,7 @@ Chat::chatTimeout(const ptr_lib::shared_ptr<const Interest>& interest)
 }
 
 void
-Chat::heartbeat(const ptr_lib::shared_ptr<const Interest> &interest)
+Chat::heartbeat()
 {
   if (!enabled_)
     return ;
@@ -260,10 +258,7 @@ Chat::heartbeat(const ptr_lib::shared_ptr<const Interest> &interest)
   sync_->publishNextSequenceNo();
   messageCacheAppend(SyncDemo::ChatMessage_ChatMessageType_HELLO, "xxx");
 
-  Interest timeout("/local/timeout");
-  timeout.setInterestLifetimeMilliseconds(heartbeatInterval_);
-  faceProcessor_.expressInterest
-    (timeout, dummyOnData, bind(&Chat::heartbeat, shared_from_this(), _1));
+  scheduler_.schedule(heartbeatInterval_, bind(&Chat::heartbeat, shared_from_this()));
 }
 
 void
@@ -294,8 +289,7 @@ Chat::leave()
 
 void
 Chat::alive
-  (const ptr_lib::shared_ptr<const Interest> &interest, int temp_seq,
-   const string& name, int session, const string& prefix)
+  (int temp_seq, const string& name, int session, const string& prefix)
 {
   if (!enabled_)
     return ;
@@ -313,8 +307,10 @@ Chat::alive
 
     if (temp_seq == seq){
       roster_.erase(n);
-      notifyObserver(MessageTypes::LEAVE, interest->getName().getSubName
-        (0, interest->getName().size() - prefixFromInstEnd_).toUri().c_str(), name.c_str(), "", 0);
+      // prefix is the chat prefix of the user, the hub prefix is in front of it
+      Name chatPrefix(prefix);
+      notifyObserver(MessageTypes::LEAVE, chatPrefix.getSubName
+        (0, chatPrefix.size() - prefixFromChatPrefixEnd_).toUri().c_str(), name.c_str(), "", 0);
     }
   }
 }
@@ -350,23 +346,6 @@ Chat::onRegisterFailed(const ptr_lib::shared_ptr<const Name>& prefix)
   cout << "Register failed for prefix " << prefix->toUri() << endl;
 }
 
-MillisecondsSince1970
-Chat::getNowMilliseconds()
-{
-  struct timeval t;
-  // Note: configure.ac requires gettimeofday.
-  gettimeofday(&t, 0);
-  return t.tv_sec * 1000.0 + t.tv_usec / 1000.0;
-}
-
-void
-Chat::dummyOnData
-(const ptr_lib::shared_ptr<const Interest>& interest,
- const ptr_lib::shared_ptr<Data>& data)
-{
-
-}
-
 int 
 Chat::notifyObserver(MessageTypes type, const char *prefix, const char *name, const char *msg, double timestamp)
 {
@@ -3,6 +3,9 @@
 #include <sys/time.h>
 #include <openssl/rand.h>
 #include <iostream>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
 
 #include <algorithm>
 
@@ -20,56 +23,203 @@ EntityDiscovery::publishEntity
   (std::string entityName, Name localPrefix, ptr_lib::shared_ptr<EntityInfoBase> entityInfo) 
 {
   Name entityFullName = Name(localPrefix).append(entityName);
+  std::string fullName = entityFullName.toUri();
     
-  std::map<std::string, ndn::ptr_lib::shared_ptr<EntityInfoBase>>::iterator item = hostedEntityList_.find(entityFullName.toUri());
-  if (item == hostedEntityList_.end()) {
+  EntityTable::iterator item = findEntity(fullName);
+  if (item == entities_.end() || item->second.state_ != EntityState::HOSTED) {
+    uint64_t registeredPrefixId;
+    if (sharedPrefixIds_.find(localPrefix.toUri()) != sharedPrefixIds_.end()) {
+      // Entities published in bulk under localPrefix registered it already
+      registeredPrefixId = acquireSharedPrefix(localPrefix, 1);
+    }
+    else {
+      registeredPrefixId = faceProcessor_.registerPrefix
+        (entityFullName, 
+         (const ndn::OnInterestCallback&)bind(&EntityDiscovery::onInterestCallback, this, _1, _2, _3, _4, _5), 
+         bind(&EntityDiscovery::onRegisterFailed, this, _1));
+    }
+  
+    hostEntity(item, fullName, entityInfo, registeredPrefixId);
+    
+    // The first hosted entity starts the lease, in the same digest change
+    if (leasePeriod_ > 0 && leaseObject_.empty()) {
+      renewLeaseWith(std::vector<std::string>(1, fullName));
+    }
+    else {
+      syncBasedDiscovery_->publishObject(fullName);
+    }
+    return true;
+  }
+  else {
+    updateHostedEntity(item, fullName, entityInfo);
+    
+    // A new lease version makes peers fetch this host's entities again
+    if (leasePeriod_ > 0) {
+      leaseVersion_ ++;
+      renewLease();
+    }
+    return true;
+  }
+}
 
-    uint64_t registeredPrefixId = faceProcessor_.registerPrefix
-      (entityFullName, 
-       (const ndn::OnInterestCallback&)bind(&EntityDiscovery::onInterestCallback, this, _1, _2, _3, _4, _5), 
-       bind(&EntityDiscovery::onRegisterFailed, this, _1));
+size_t
+EntityDiscovery::publishEntities
+  (const std::vector<std::string>& entityNames, Name localPrefix, 
+   const std::vector<ptr_lib::shared_ptr<EntityInfoBase> >& entityInfos)
+{
+  if (entityNames.size() != entityInfos.size()) {
+    throw std::runtime_error("Each entity needs its info.");
+  }
   
-    syncBasedDiscovery_->publishObject(entityFullName.toUri());
+  std::vector<std::string> newNames;
+  std::vector<size_t> newEntities;
+  // Names repeated in entityNames count once
+  std::set<std::string> publishedNames;
+  bool isUpdated = false;
+  for (size_t i = 0; i < entityNames.size(); ++i) {
+    std::string fullName = Name(localPrefix).append(entityNames[i]).toUri();
+    EntityTable::iterator item = findEntity(fullName);
+    if (item != entities_.end() && item->second.state_ == EntityState::HOSTED) {
+      updateHostedEntity(item, fullName, entityInfos[i]);
+      publishedNames.insert(fullName);
+      isUpdated = true;
+    }
+    else {
+      newNames.push_back(fullName);
+      newEntities.push_back(i);
+    }
+  }
   
-    // this destroys the parent class object.
-    ptr_lib::shared_ptr<EntityInfoBase> info = entityInfo;
-    info->setRegisteredPrefixId(registeredPrefixId);
+  if (!newNames.empty()) {
+    // One registration covers every entity under localPrefix
+    uint64_t registeredPrefixId = acquireSharedPrefix(localPrefix, newNames.size());
+    
+    for (size_t i = 0; i < newNames.size(); ++i) {
+      // Names repeated in entityNames were hosted by their first occurrence
+      EntityTable::iterator item = findEntity(newNames[i]);
+      if (item != entities_.end() && item->second.state_ == EntityState::HOSTED) {
+        updateHostedEntity(item, newNames[i], entityInfos[newEntities[i]]);
+        releaseRegisteredPrefix(registeredPrefixId);
+        isUpdated = true;
+      }
+      else {
+        hostEntity(item, newNames[i], entityInfos[newEntities[i]], registeredPrefixId);
+      }
+      publishedNames.insert(newNames[i]);
+    }
+  }
   
-    hostedEntityList_.insert
-      (std::pair<std::string, ndn::ptr_lib::shared_ptr<EntityInfoBase>>(entityFullName.toUri(), info));
+  // The lease changes in the same digest change as the new entities are published
+  if (leasePeriod_ > 0 && (isUpdated || leaseObject_.empty())) {
+    if (isUpdated) {
+      leaseVersion_ ++;
+    }
+    renewLeaseWith(newNames);
+  }
+  else if (!newNames.empty()) {
+    syncBasedDiscovery_->publishObjects(newNames);
+  }
+  return publishedNames.size();
+}
+
+void
+EntityDiscovery::hostEntity
+  (EntityTable::iterator item, const std::string& fullName, 
+   ptr_lib::shared_ptr<EntityInfoBase> entityInfo, uint64_t registeredPrefixId)
+{
+  // this destroys the parent class object.
+  ptr_lib::shared_ptr<EntityInfoBase> info = entityInfo;
+  info->setRegisteredPrefixId(registeredPrefixId);
   
-    notifyObserver(MessageTypes::START, entityFullName.toUri().c_str(), 0);
-    hostedEntitiesNum_ ++;
-    return true;
+  if (item != entities_.end()) {
+    // Taking over an entity discovered from elsewhere: stop fetching it
+    heartbeatEngine_.cancel(item->first);
+    forgetEntityHost(item->first, item->second);
+    item->second = EntityRecord(EntityState::HOSTED);
   }
   else {
-    // For the same entity name published again, we update its EntityInfoBase object
-    ptr_lib::shared_ptr<EntityInfoBase> info = entityInfo;
-    info->setRegisteredPrefixId(item->second->getRegisteredPrefixId());
-    item->second = info;
-    
-    // SET is called for notifyObserver
-    notifyObserver(MessageTypes::SET, entityFullName.toUri().c_str(), 0);
-    return true;
+    item = addEntity(fullName, EntityState::HOSTED).first;
   }
+  item->second.info_ = info;
+  item->second.version_ = getNextVersion();
+  
+  notifyObserver(MessageTypes::START, fullName.c_str(), 0);
+  hostedEntitiesNum_ ++;
 }
 
 void
-EntityDiscovery::removeRegisteredPrefix
-  (const ptr_lib::shared_ptr<const Interest>& interest,
-   Name entityName)
+EntityDiscovery::updateHostedEntity
+  (EntityTable::iterator item, const std::string& fullName, 
+   ptr_lib::shared_ptr<EntityInfoBase> entityInfo)
+{
+  // For the same entity name published again, we update its EntityInfoBase object
+  ptr_lib::shared_ptr<EntityInfoBase> info = entityInfo;
+  info->setRegisteredPrefixId(item->second.info_->getRegisteredPrefixId());
+  item->second.info_ = info;
+  item->second.version_ = getNextVersion();
+  item->second.clearReplies();
+  
+  // SET is called for notifyObserver
+  notifyObserver(MessageTypes::SET, fullName.c_str(), 0);
+}
+
+uint64_t
+EntityDiscovery::acquireSharedPrefix(const Name& localPrefix, size_t entityCount)
+{
+  std::string prefix = localPrefix.toUri();
+  std::map<std::string, uint64_t>::iterator id = sharedPrefixIds_.find(prefix);
+  if (id == sharedPrefixIds_.end()) {
+    uint64_t registeredPrefixId = faceProcessor_.registerPrefix
+      (localPrefix, 
+       (const ndn::OnInterestCallback&)bind(&EntityDiscovery::onInterestCallback, this, _1, _2, _3, _4, _5), 
+       bind(&EntityDiscovery::onRegisterFailed, this, _1));
+    id = sharedPrefixIds_.insert(std::make_pair(prefix, registeredPrefixId)).first;
+    sharedPrefixes_.insert(std::make_pair(registeredPrefixId, SharedPrefix(prefix)));
+  }
+  sharedPrefixes_.find(id->second)->second.entityCount_ += entityCount;
+  return id->second;
+}
+
+void
+EntityDiscovery::releaseRegisteredPrefix(uint64_t registeredPrefixId)
+{
+  std::map<uint64_t, SharedPrefix>::iterator shared = sharedPrefixes_.find(registeredPrefixId);
+  if (shared != sharedPrefixes_.end()) {
+    if (-- shared->second.entityCount_ > 0) {
+      return ;
+    }
+    sharedPrefixIds_.erase(shared->second.prefix_);
+    sharedPrefixes_.erase(shared);
+  }
+  faceProcessor_.removeRegisteredPrefix(registeredPrefixId);
+}
+
+void
+EntityDiscovery::removeRegisteredPrefix(Name entityName)
 { 
-  std::map<std::string, ndn::ptr_lib::shared_ptr<EntityInfoBase>>::iterator item = hostedEntityList_.find(entityName.toUri());
-  if (item != hostedEntityList_.end()) {
-    faceProcessor_.removeRegisteredPrefix(item->second->getRegisteredPrefixId());
-    hostedEntityList_.erase(item);
+  EntityTable::iterator item = findEntity(entityName.toUri());
+  if (item != entities_.end() && item->second.state_ == EntityState::HOSTED) {
+    releaseRegisteredPrefix(item->second.info_->getRegisteredPrefixId());
+    eraseEntity(item);
     hostedEntitiesNum_ --;
+    
+    if (leasePeriod_ > 0 && hostedEntitiesNum_ == 0) {
+      renewLease();
+    }
   }
   else {
     cerr << "No such entity exists." << endl;
   }
 }
 
+void
+EntityDiscovery::removeRegisteredPrefixes(std::vector<Name> entityNames)
+{
+  for (size_t i = 0; i < entityNames.size(); ++i) {
+    removeRegisteredPrefix(entityNames[i]);
+  }
+}
+
 bool
 EntityDiscovery::stopPublishingEntity
   (std::string entityName, ndn::Name prefix)
@@ -77,18 +227,22 @@ EntityDiscovery::stopPublishingEntity
   if (hostedEntitiesNum_ > 0) {
     Name entityBeingStopped = Name(prefix).append(entityName);
     
-    std::map<std::string, ndn::ptr_lib::shared_ptr<EntityInfoBase>>::iterator item = hostedEntityList_.find(entityBeingStopped.toUri());
+    EntityTable::iterator item = findEntity(entityBeingStopped.toUri());
   
-    if (item != hostedEntityList_.end()) {
-      item->second->setBeingRemoved(true);
+    if (item != entities_.end() && item->second.state_ == EntityState::HOSTED) {
+      item->second.info_->setBeingRemoved(true);
+      item->second.clearReplies();
       syncBasedDiscovery_->removeObject(entityBeingStopped.toUri(), true);
       
-      Interest timeout("/local/timeout");
-      timeout.setInterestLifetimeMilliseconds(defaultKeepPeriod_);
-
-      faceProcessor_.expressInterest
-        (timeout, bind(&EntityDiscovery::dummyOnData, this, _1, _2),
-         bind(&EntityDiscovery::removeRegisteredPrefix, this, _1, entityBeingStopped));
+      // Peers following the lease learn the entity is over by fetching it again
+      if (leasePeriod_ > 0) {
+        leaseVersion_ ++;
+        renewLease();
+      }
+      
+      scheduler_.schedule
+        (defaultKeepPeriod_, 
+         bind(&EntityDiscovery::removeRegisteredPrefix, this, entityBeingStopped));
     
       notifyObserver(MessageTypes::STOP, entityBeingStopped.toUri().c_str(), 0);
       
@@ -105,6 +259,48 @@ EntityDiscovery::stopPublishingEntity
   }
 }
 
+size_t
+EntityDiscovery::stopPublishingEntities
+  (const std::vector<std::string>& entityNames, ndn::Name prefix)
+{
+  std::vector<Name> entitiesBeingStopped;
+  std::vector<std::string> stoppedNames;
+  for (size_t i = 0; i < entityNames.size(); ++i) {
+    Name entityBeingStopped = Name(prefix).append(entityNames[i]);
+    std::string fullName = entityBeingStopped.toUri();
+    
+    EntityTable::iterator item = findEntity(fullName);
+    if (item != entities_.end() && item->second.state_ == EntityState::HOSTED &&
+        !item->second.info_->getBeingRemoved()) {
+      item->second.info_->setBeingRemoved(true);
+      item->second.clearReplies();
+      entitiesBeingStopped.push_back(entityBeingStopped);
+      stoppedNames.push_back(fullName);
+    }
+  }
+  if (stoppedNames.empty()) {
+    cerr << "No such entities exist." << endl;
+    return 0;
+  }
+  
+  syncBasedDiscovery_->stopPublishingObjects(stoppedNames);
+  
+  // Peers following the lease learn the entities are over by fetching them again
+  if (leasePeriod_ > 0) {
+    leaseVersion_ ++;
+    renewLease();
+  }
+  
+  scheduler_.schedule
+    (defaultKeepPeriod_, 
+     bind(&EntityDiscovery::removeRegisteredPrefixes, this, entitiesBeingStopped));
+  
+  for (size_t i = 0; i < stoppedNames.size(); ++i) {
+    notifyObserver(MessageTypes::STOP, stoppedNames[i].c_str(), 0);
+  }
+  return stoppedNames.size();
+}
+
 void 
 EntityDiscovery::onReceivedSyncData
   (const std::vector<std::string>& syncData)
@@ -113,12 +309,13 @@ EntityDiscovery::onReceivedSyncData
     return ;
     
   for (size_t j = 0; j < syncData.size(); ++j) {
-    std::map<std::string, ndn::ptr_lib::shared_ptr<EntityInfoBase>>::iterator hostedItem = hostedEntityList_.find(syncData[j]);
-    std::vector<std::string>::iterator queriedItem = std::find(queriedEntityList_.begin(), queriedEntityList_.end(), syncData[j]);
-    
-    if (hostedItem == hostedEntityList_.end() && queriedItem == queriedEntityList_.end()) {
-      queriedEntityList_.push_back(syncData[j]);
+    if (onLeaseObject(syncData[j])) {
+      continue;
+    }
     
+    // Hosted, discovered and already queried entities all have a record
+    std::pair<EntityTable::iterator, bool> added = addEntity(syncData[j], EntityState::QUERIED);
+    if (added.second) {
       Name name(syncData[j]);
       Interest interest(name);
       
@@ -126,8 +323,9 @@ EntityDiscovery::onReceivedSyncData
       interest.setMustBeFresh(true);
       
       faceProcessor_.expressInterest
-        (interest, bind(&EntityDiscovery::onData, this, _1, _2),
-         bind(&EntityDiscovery::onTimeout, this, _1));
+        (interest, bind(&EntityDiscovery::onData, this, added.first->first, _1, _2),
+         bind(&EntityDiscovery::onTimeout, this, added.first->first, _1));
+      interestsSent_.increment();
     }
   }
 }
@@ -140,62 +338,256 @@ EntityDiscovery::onInterestCallback
 {
   if (!enabled_)
     return ;
-    
-  std::map<std::string, ndn::ptr_lib::shared_ptr<EntityInfoBase>>::iterator item = hostedEntityList_.find(interest->getName().toUri());
+  interestsReceived_.increment();
   
-  if (item != hostedEntityList_.end()) {
+  const Name& interestName = interest->getName();
+  size_t entityNameSize = getEntityNameSize(interestName);
+  EntityTable::iterator item = findEntity
+    (entityNameSize == interestName.size() ? interestName.toUri() : interestName.getPrefix(entityNameSize).toUri());
   
-    Data data(interest->getName());
+  // An entity under a shared prefix may also have a registration of its own, and only
+  // the registration it was hosted with answers
+  if (item != entities_.end() && item->second.state_ == EntityState::HOSTED &&
+      item->second.info_->getRegisteredPrefixId() == registeredPrefixId) {
+    EntityRecord& record = item->second;
+    bool isConditional = entityNameSize < interestName.size();
+    
+    // Replies to plain heartbeats, and to conditional ones that have the current version, 
+    // are the same for every peer, and are signed once
+    if (isConditional && !record.info_->getBeingRemoved() && 
+        isComponent(interestName.get(-1), record.version_)) {
+      // The peer has this version already. The reply is never fresh, so that 
+      // caches don't answer other interests for the entity with it
+      if (!record.sameReply_) {
+        record.sameReply_ = makeReply(interestName, Blob((const uint8_t *)"same", 4), 0);
+      }
+      face.putData(*record.sameReply_);
+    }
+    else if (!isConditional && record.reply_) {
+      face.putData(*record.reply_);
+    }
+    else {
+      ptr_lib::shared_ptr<Data> data;
+      if (record.info_->getBeingRemoved() == false) {
+        if (record.content_.isNull()) {
+          record.content_ = serializer_->serialize(record.info_);
+        }
+        data = makeReply
+          (Name(interestName).append("version").append(record.version_), record.content_, 
+           defaultDataFreshnessPeriod_);
+      } else {
+        data = makeReply(interestName, Blob((const uint8_t *)"over", 4), defaultDataFreshnessPeriod_);
+      }
+      
+      if (!isConditional) {
+        record.reply_ = data;
+      }
+      face.putData(*data);
+    }
+  }
+  else if (sharedPrefixes_.find(registeredPrefixId) == sharedPrefixes_.end() &&
+           (item == entities_.end() || item->second.state_ != EntityState::HOSTED)) {
+    // Other names under a shared prefix belong to the rest of the application
+    cerr << "Received interest about entity not hosted by this instance." << endl;
+  }
+}
+
+ptr_lib::shared_ptr<Data>
+EntityDiscovery::makeReply(const Name& name, const Blob& content, Milliseconds freshnessPeriod)
+{
+  ptr_lib::shared_ptr<Data> data(new Data(name));
+  if (leasePeriod_ > 0) {
+    // Names the lease covering this entity
+    data->getName().append("lease").append(hostId_);
+  }
+  data->setContent(content);
+  data->getMetaInfo().setFreshnessPeriod(freshnessPeriod);
   
-    if (item->second->getBeingRemoved() == false) {
-      data.setContent(serializer_->serialize(item->second));
-    } else {
-      string content("over");
-      data.setContent((const uint8_t *)&content[0], content.size());
+  keyChain_.sign(*data, certificateName_);
+  dataSigned_.increment();
+  // Sending a cached reply again reuses this encoding
+  data->wireEncode();
+  return data;
+}
+
+/**
+ * Check if content is the "over" reply of an entity that's being removed, without
+ * copying it out of the packet.
+ */
+static bool
+isOverContent(const Blob& content)
+{
+  return content.size() == 4 && memcmp(content.buf(), "over", 4) == 0;
+}
+
+/**
+ * Check if content is the "same" reply to a conditional heartbeat.
+ */
+static bool
+isSameContent(const Blob& content)
+{
+  return content.size() == 4 && memcmp(content.buf(), "same", 4) == 0;
+}
+
+bool
+EntityDiscovery::isComponent(const Name::Component& component, const std::string& value)
+{
+  const Blob& bytes = component.getValue();
+  return bytes.size() == value.size() && memcmp(bytes.buf(), value.data(), value.size()) == 0;
+}
+
+size_t
+EntityDiscovery::getEntityNameSize(const Name& interestName)
+{
+  size_t size = interestName.size();
+  if (size >= 2 && isComponent(interestName.get(size - 2), "since")) {
+    return size - 2;
+  }
+  return size;
+}
+
+void
+EntityDiscovery::parseReplyName
+  (const Name& dataName, size_t entityNameSize, 
+   const Name::Component *& version, const Name::Component *& hostId)
+{
+  version = 0;
+  hostId = 0;
+  // A conditional heartbeat's since/<version> pair is skipped
+  for (size_t i = entityNameSize; i + 1 < dataName.size(); i += 2) {
+    if (isComponent(dataName.get(i), "version")) {
+      version = &dataName.get(i + 1);
     }
-    
-    data.getMetaInfo().setFreshnessPeriod(defaultDataFreshnessPeriod_);
+    else if (isComponent(dataName.get(i), "lease")) {
+      hostId = &dataName.get(i + 1);
+    }
+  }
+}
 
-    keyChain_.sign(data, certificateName_);
+void
+EntityDiscovery::assignComponent(std::string& value, const Name::Component *component)
+{
+  if (!component) {
+    value.clear();
+  }
+  else if (!isComponent(*component, value)) {
+    value = component->toEscapedString();
+  }
+}
 
-    face.putData(data);
+/**
+ * Check if the first size components of name are written uri, as Name::toUri writes
+ * them, without writing them: generic components escape each byte but letters, digits 
+ * and "+-._" as %XX, and a component of only periods gets three more.
+ */
+static bool
+isUriOf(const Name& name, size_t size, const std::string& uri)
+{
+  static const char hexDigits[] = "0123456789ABCDEF";
+  if (size == 0) {
+    return uri == "/";
   }
-  else {
-    cerr << "Received interest about entity not hosted by this instance." << endl;
+  
+  size_t position = 0;
+  for (size_t i = 0; i < size; ++i) {
+    if (position >= uri.size() || uri[position++] != '/') {
+      return false;
+    }
+    const Blob& value = name.get(i).getValue();
+    bool isPeriods = true;
+    for (size_t j = 0; j < value.size() && isPeriods; ++j) {
+      isPeriods = value.buf()[j] == '.';
+    }
+    if (isPeriods) {
+      if (uri.compare(position, 3, "...") != 0) {
+        return false;
+      }
+      position += 3;
+    }
+    
+    for (size_t j = 0; j < value.size(); ++j) {
+      uint8_t x = value.buf()[j];
+      if ((x >= '0' && x <= '9') || (x >= 'A' && x <= 'Z') || (x >= 'a' && x <= 'z') ||
+          x == '+' || x == '-' || x == '.' || x == '_') {
+        if (position >= uri.size() || uri[position++] != (char)x) {
+          return false;
+        }
+      }
+      else if (position + 3 > uri.size() || uri[position] != '%' ||
+               uri[position + 1] != hexDigits[x >> 4] || uri[position + 2] != hexDigits[x & 0x0F]) {
+        return false;
+      }
+      else {
+        position += 3;
+      }
+    }
   }
+  return position == uri.size();
+}
+
+EntityDiscovery::EntityTable::iterator
+EntityDiscovery::findHeartbeatEntity(NameTable::Id entity, const Name& interestName)
+{
+  EntityTable::iterator item = entities_.find(entity);
+  if (item == entities_.end()) {
+    return item;
+  }
+  
+  size_t entityNameSize = getEntityNameSize(interestName);
+  const std::string& entityName = nameTable_->get(entity);
+  // Compared in place; toUri only settles names that isUriOf doesn't write the same way
+  if (!isUriOf(interestName, entityNameSize, entityName) &&
+      interestName.getPrefix(entityNameSize).toUri() != entityName) {
+    return entities_.end();
+  }
+  return item;
 }
 
 void 
 EntityDiscovery::onData
-  (const ptr_lib::shared_ptr<const Interest>& interest,
+  (NameTable::Id entity, const ptr_lib::shared_ptr<const Interest>& interest,
    const ptr_lib::shared_ptr<Data>& data)
 {
   if (!enabled_)
     return ;
     
-  std::string entityName = interest->getName().toUri();
-  
-  std::map<string, ptr_lib::shared_ptr<EntityInfoBase>>::iterator item = discoveredEntityList_.find
-    (entityName);
-  
-  string content = "";
-  for (size_t i = 0; i < data->getContent().size(); ++i) {
-    content += (*data->getContent())[i];
+  // Entities without a record have no heartbeat
+  const Name& interestName = interest->getName();
+  EntityTable::iterator item = findHeartbeatEntity(entity, interestName);
+  if (item == entities_.end()) {
+    return ;
+  }
+  heartbeatEngine_.onHeartbeatDone(item->first, true);
+  if (item->second.state_ == EntityState::HOSTED) {
+    return ;
   }
   
+  bool isOver = isOverContent(data->getContent());
+  // Only conditional heartbeats are answered with "same"
+  size_t entityNameSize = getEntityNameSize(interestName);
+  bool isSame = entityNameSize < interestName.size() && isSameContent(data->getContent());
+  const Name::Component *version;
+  const Name::Component *hostId;
+  parseReplyName(data->getName(), entityNameSize, version, hostId);
+  // Valid until the record is erased
+  const std::string& entityName = nameTable_->get(item->first);
+  
   // if it's not an already discovered entity
-  if (item == discoveredEntityList_.end()) {
+  if (item->second.state_ == EntityState::QUERIED) {
     // if it's still going on
-    if (content != "over") {
-      ptr_lib::shared_ptr<EntityInfoBase> entityInfo = serializer_->deserialize(data->getContent());
+    if (!isOver) {
+      ptr_lib::shared_ptr<EntityInfoBase> entityInfo;
+      if (!isSame) {
+        entityInfo = serializer_->deserialize(data->getContent());
+      }
       
       if (entityInfo) {
-        discoveredEntityList_.insert
-          (std::pair<string, ptr_lib::shared_ptr<EntityInfoBase>>
-            (entityName, entityInfo));
-  
-        // std::map should be sorted by default
-        //std::sort(discoveredEntityList_.begin(), discoveredEntityList_.end());
+        EntityRecord& record = item->second;
+        record.state_ = EntityState::DISCOVERED;
+        record.info_ = entityInfo;
+        record.content_ = data->getContent();
+        assignComponent(record.version_, version);
+        record.timeoutCount_ = 0;
 
         // Probably need lock for adding/removing objects in SyncBasedDiscovery class.
         // Here we update hash as well as adding object; The next interest will carry the new digest
@@ -203,75 +595,70 @@ EntityDiscovery::onData
         // Expect this to be equal with 0 several times. 
         // Because new digest does not get updated immediately
         if (syncBasedDiscovery_->addObject(entityName, true) == 0) {
-          cerr << "Did not add to the discoveredEntityList_ in syncBasedDiscovery_" << endl;
+          cerr << "Did not add to the discovered entities in syncBasedDiscovery_" << endl;
         }
 
         notifyObserver(MessageTypes::ADD, entityName.c_str(), 0);
 
-        Interest timeout("/local/timeout");
-        timeout.setInterestLifetimeMilliseconds(defaultHeartbeatInterval_);
-
-        // express heartbeat interest after 2 seconds of sleep
-        faceProcessor_.expressInterest
-          (timeout, bind(&EntityDiscovery::dummyOnData, this, _1, _2),
-           bind(&EntityDiscovery::expressHeartbeatInterest, this, _1, interest));
+        // express heartbeat interest after the policy's first interval, unless the host's lease covers it
+        record.heartbeatInterval_ = heartbeatPolicy_.getMinInterval();
+        if (!updateEntityHost(item->first, record, hostId)) {
+          heartbeatEngine_.schedule(item->first, record.heartbeatInterval_);
+        }
       }
       else {
         // If received entityInfo is malformed, 
         // re-express interest after a timeout.
-        Interest timeout("/local/timeout");
-        timeout.setInterestLifetimeMilliseconds(defaultHeartbeatInterval_);
-
-        // express heartbeat interest after 2 seconds of sleep
-        faceProcessor_.expressInterest
-          (timeout, bind(&EntityDiscovery::dummyOnData, this, _1, _2),
-           bind(&EntityDiscovery::expressHeartbeatInterest, this, _1, interest));
+        heartbeatEngine_.schedule(item->first, heartbeatPolicy_.getMinInterval());
       }
     }
     // if the not already discovered entity is already over.
     else {
-      std::vector<string>::iterator queriedItem = std::find
-        (queriedEntityList_.begin(), queriedEntityList_.end(), entityName);
-      if (queriedItem != queriedEntityList_.end()) {
-        queriedEntityList_.erase(queriedItem);
-      }
+      eraseEntity(item);
     }
   }
   // if it's an already discovered entity
   else {
-    if (content != "over") {
-      item->second->resetTimeout();
+    EntityRecord& record = item->second;
+    if (!isOver) {
+      record.timeoutCount_ = 0;
       
-      // Using set messages for updated entitys
-      ptr_lib::shared_ptr<EntityInfoBase> entityInfo = serializer_->deserialize(data->getContent());
-      
-      if (!serializer_->serialize(entityInfo).equals(serializer_->serialize(item->second))) {
-        item->second = entityInfo;
-        
-        notifyObserver(MessageTypes::SET, entityName.c_str(), 0);
+      // Using set messages for updated entitys; an unchanged reply is not deserialized
+      bool isChanged = false;
+      if (!isSame) {
+        if (!data->getContent().equals(record.content_)) {
+          ptr_lib::shared_ptr<EntityInfoBase> entityInfo = serializer_->deserialize(data->getContent());
+          // A malformed reply keeps the last good info, and the next reply is compared against it
+          if (entityInfo) {
+            record.info_ = entityInfo;
+            record.content_ = data->getContent();
+            isChanged = true;
+            
+            notifyObserver(MessageTypes::SET, entityName.c_str(), 0);
+          }
+        }
+        // Next heartbeats ask for changes since the version of record.info_
+        if (data->getContent().equals(record.content_)) {
+          assignComponent(record.version_, version);
+        }
       }
       
-      Interest timeout("/local/timeout");
-      timeout.setInterestLifetimeMilliseconds(defaultHeartbeatInterval_);
-
-      // express heartbeat interest after 2 seconds of sleep
-      faceProcessor_.expressInterest
-        (timeout, bind(&EntityDiscovery::dummyOnData, this, _1, _2),
-         bind(&EntityDiscovery::expressHeartbeatInterest, this, _1, interest));
+      // Stable entities are polled less often, changed ones more
+      record.heartbeatInterval_ = heartbeatPolicy_.getNextInterval(record.heartbeatInterval_, isChanged);
+      
+      // express heartbeat interest after the interval, unless the host's lease covers it
+      if (!updateEntityHost(item->first, record, hostId)) {
+        heartbeatEngine_.schedule(item->first, record.heartbeatInterval_);
+      }
     }
     // If the discovered entity marks itself as "over"; This is updated to use "STOP" instead of "REMOVE", so that the latter's easier to differentiate, and is only caused by a series of interest timeouts
     else {
       notifyObserver(MessageTypes::STOP, entityName.c_str(), 0);
       
-      if (syncBasedDiscovery_->removeObject(item->first, true) == 0) {
-        cerr << "Did not remove from the discoveredEntityList_ in syncBasedDiscovery_" << endl;
-      }
-      std::vector<string>::iterator queriedItem = std::find
-        (queriedEntityList_.begin(), queriedEntityList_.end(), entityName);
-      if (queriedItem != queriedEntityList_.end()) {
-        queriedEntityList_.erase(queriedItem);
+      if (syncBasedDiscovery_->removeObject(entityName, true) == 0) {
+        cerr << "Did not remove from the discovered entities in syncBasedDiscovery_" << endl;
       }
-      discoveredEntityList_.erase(item);
+      eraseEntity(item);
     }
   }
 }
@@ -283,73 +670,240 @@ EntityDiscovery::onData
  */
 void
 EntityDiscovery::onTimeout
-  (const ptr_lib::shared_ptr<const Interest>& interest)
+  (NameTable::Id entity, const ptr_lib::shared_ptr<const Interest>& interest)
 {
   if (!enabled_)
     return ;
     
-  // entityName is the full name of the entity, with the last component being the entity name string.
-  std::string entityName = interest->getName().toUri();
+  EntityTable::iterator item = findHeartbeatEntity(entity, interest->getName());
+  if (item == entities_.end()) {
+    return ;
+  }
+  heartbeatEngine_.onHeartbeatDone(item->first, false);
+  // entityName is the full name of the entity, valid until the record is erased
+  const std::string& entityName = nameTable_->get(item->first);
   
-  std::map<string, ptr_lib::shared_ptr<EntityInfoBase>>::iterator item = discoveredEntityList_.find
-    (entityName);
-  if (item != discoveredEntityList_.end()) {
+  EntityRecord& record = item->second;
+  if (record.state_ == EntityState::DISCOVERED) {
     // TODO: This seems to be the only way of getting REMOVE (manual stop gets you STOP, instead of REMOVE); see how this's called
-    cerr << "** Entity heartbeat interest timeout called, interest: " << interest->getName().toUri() << "; Current timeout count: " << item->second->getTimeoutCount() << endl;
-    if (item->second && item->second->incrementTimeout()) {
+    cerr << "** Entity heartbeat interest timeout called, interest: " << interest->getName().toUri() << "; Current timeout count: " << record.timeoutCount_ << endl;
+    // (timeoutCount + 2) timeouts in a row remove the entity, as HeartbeatPolicy says
+    if (record.timeoutCount_ ++ > heartbeatPolicy_.getTimeoutCount()) {
       notifyObserver(MessageTypes::REMOVE, entityName.c_str(), 0);
       
       // Probably need lock for adding/removing objects in SyncBasedDiscovery class.
-      if (syncBasedDiscovery_->removeObject(item->first, true) == 0) {
-        cerr << "Did not remove from the discoveredEntityList_ in syncBasedDiscovery_" << endl;
+      if (syncBasedDiscovery_->removeObject(entityName, true) == 0) {
+        cerr << "Did not remove from the discovered entities in syncBasedDiscovery_" << endl;
       }
-  
-      // erase the item after it's removed in removeObject, or removeObject would remove the
-      // wrong element: iterator is actually representing a position index, and the two vectors
-      // should be exactly the same: (does it make sense for them to be shared, 
-      // and mutex-locked correspondingly?)
-      discoveredEntityList_.erase(item);
       
-      std::vector<string>::iterator queriedItem = std::find
-        (queriedEntityList_.begin(), queriedEntityList_.end(), entityName);
-      if (queriedItem != queriedEntityList_.end()) {
-        queriedEntityList_.erase(queriedItem);
-      }
+      eraseEntity(item);
     }
     else {
-      Interest timeout("/local/timeout");
-      timeout.setInterestLifetimeMilliseconds(defaultTimeoutReexpressInterval_);
-      faceProcessor_.expressInterest
-        (timeout, bind(&EntityDiscovery::dummyOnData, this, _1, _2),
-         bind(&EntityDiscovery::expressHeartbeatInterest, this, _1, interest));
+      // A missed heartbeat puts the entity back to the shortest interval
+      record.heartbeatInterval_ = heartbeatPolicy_.getMinInterval();
+      heartbeatEngine_.schedule(item->first, heartbeatPolicy_.getReexpressInterval());
     }
   }
-  else {
-    std::vector<string>::iterator queriedItem = std::find
-      (queriedEntityList_.begin(), queriedEntityList_.end(), entityName);
-    if (queriedItem != queriedEntityList_.end()) {
-      queriedEntityList_.erase(queriedItem);
-    } 
+  else if (record.state_ == EntityState::QUERIED) {
+    eraseEntity(item);
   }
 }
 
 void
-EntityDiscovery::expressHeartbeatInterest
-  (const ptr_lib::shared_ptr<const Interest>& interest,
-   const ptr_lib::shared_ptr<const Interest>& entityInterest)
+EntityDiscovery::expressHeartbeatInterest(NameTable::Id entity)
 {
   if (!enabled_)
     return ;
   
-  Interest newInterest(entityInterest->getName());
+  Interest newInterest(Name(nameTable_->get(entity)));
+  EntityTable::iterator item = entities_.find(entity);
+  if (item != entities_.end() && !item->second.version_.empty()) {
+    // Conditional heartbeat: an unchanged entity is answered with "same". Its name is
+    // no prefix of the full reply's version/<version>, so that caches holding the full
+    // reply don't answer it in place of the host
+    newInterest.getName().append("since").append(item->second.version_);
+  }
   
   newInterest.setInterestLifetimeMilliseconds(defaultHeartbeatInterval_);
   newInterest.setMustBeFresh(true);
   
   faceProcessor_.expressInterest
     (newInterest,
-     bind(&EntityDiscovery::onData, this, _1, _2), 
-     bind(&EntityDiscovery::onTimeout, this, _1));
+     bind(&EntityDiscovery::onData, this, entity, _1, _2), 
+     bind(&EntityDiscovery::onTimeout, this, entity, _1));
+  interestsSent_.increment();
+}
+
+void
+EntityDiscovery::renewLeaseWith(const std::vector<std::string>& names)
+{
+  if (!enabled_)
+    return ;
+  
+  leaseEvent_.cancel();
+  if (hostedEntitiesNum_ == 0) {
+    if (!leaseObject_.empty()) {
+      syncBasedDiscovery_->removeObject(leaseObject_, true);
+      leaseObject_.clear();
+    }
+    return ;
+  }
+  
+  // The old epoch is replaced in the same digest change as the new one is added, 
+  // and the sync interest for the new digest replaces the outstanding one
+  if (!leaseObject_.empty()) {
+    syncBasedDiscovery_->removeObject(leaseObject_, false);
+  }
+  ostringstream object;
+  object << leasePrefix_ << hostId_ << "/" << (uint64_t)leasePeriod_ << "/" 
+         << leaseVersion_ << "/" << ++leaseEpoch_;
+  leaseObject_ = object.str();
+  std::vector<std::string> objects(names);
+  objects.push_back(leaseObject_);
+  syncBasedDiscovery_->publishObjects(objects);
+  
+  leaseEvent_ = scheduler_.schedule
+    (leasePeriod_, bind(&EntityDiscovery::renewLease, this));
+}
+
+bool
+EntityDiscovery::onLeaseObject(const std::string& object)
+{
+  if (object.compare(0, leasePrefix_.size(), leasePrefix_) != 0) {
+    return false;
+  }
+  
+  istringstream fields(object.substr(leasePrefix_.size()));
+  string hostId;
+  uint64_t period, version, epoch;
+  char separator;
+  getline(fields, hostId, '/');
+  fields >> period >> separator >> version >> separator >> epoch;
+  if (fields.fail() || hostId == hostId_) {
+    return true;
+  }
+  
+  Lease& lease = leases_[hostId];
+  // The symmetric difference also lists the epochs peers have not replaced yet
+  if (epoch <= lease.epoch_) {
+    return true;
+  }
+  bool isChanged = lease.epoch_ != 0 && version != lease.version_;
+  
+  if (!lease.object_.empty()) {
+    syncBasedDiscovery_->removeObject(lease.object_, false);
+  }
+  syncBasedDiscovery_->addObject(object, true);
+  lease.object_ = object;
+  lease.epoch_ = epoch;
+  lease.version_ = version;
+  
+  // One renewal may be lost before the lease expires
+  lease.expiryEvent_.cancel();
+  lease.expiryEvent_ = scheduler_.schedule
+    (2 * period, bind(&EntityDiscovery::onLeaseExpired, this, hostId, epoch));
+  
+  if (isChanged) {
+    for (std::set<NameTable::Id>::iterator it = lease.entities_.begin(); it != lease.entities_.end(); ++it) {
+      heartbeatEngine_.schedule(*it, 0);
+    }
+  }
+  return true;
+}
+
+void
+EntityDiscovery::onLeaseExpired(std::string hostId, uint64_t epoch)
+{
+  if (!enabled_)
+    return ;
+  
+  std::map<string, Lease>::iterator item = leases_.find(hostId);
+  if (item == leases_.end() || item->second.epoch_ != epoch) {
+    return ;
+  }
+  
+  // Keep the record, so that stale epochs still floating in the sync state are ignored
+  syncBasedDiscovery_->removeObject(item->second.object_, true);
+  item->second.object_.clear();
+  
+  // Heartbeats decide whether the entities are gone, as for hosts without leases
+  for (std::set<NameTable::Id>::iterator it = item->second.entities_.begin(); it != item->second.entities_.end(); ++it) {
+    heartbeatEngine_.schedule(*it, 0);
+  }
+}
+
+bool
+EntityDiscovery::updateEntityHost
+  (NameTable::Id entity, EntityRecord& record, const Name::Component *hostId)
+{
+  if (!hostId) {
+    return false;
+  }
+  
+  if (!isComponent(*hostId, record.hostId_)) {
+    forgetEntityHost(entity, record);
+    record.hostId_ = hostId->toEscapedString();
+  }
+  
+  Lease& lease = leases_[record.hostId_];
+  lease.entities_.insert(entity);
+  return !lease.object_.empty();
+}
+
+void
+EntityDiscovery::forgetEntityHost(NameTable::Id entity, EntityRecord& record)
+{
+  if (!record.hostId_.empty()) {
+    leases_[record.hostId_].entities_.erase(entity);
+    record.hostId_.clear();
+  }
+}
+
+std::pair<EntityDiscovery::EntityTable::iterator, bool>
+EntityDiscovery::addEntity(const std::string& entityName, EntityState state)
+{
+  NameTable::Id id = nameTable_->intern(entityName);
+  std::pair<EntityTable::iterator, bool> result = entities_.insert
+    (EntityTable::value_type(id, EntityRecord(state)));
+  if (!result.second) {
+    // The record already holds a reference
+    nameTable_->release(id);
+  }
+  return result;
+}
+
+void
+EntityDiscovery::eraseEntity(EntityTable::iterator item)
+{
+  NameTable::Id id = item->first;
+  // The Id must not be used once the name is released
+  heartbeatEngine_.cancel(id);
+  forgetEntityHost(id, item->second);
+  entities_.erase(item);
+  nameTable_->release(id);
+}
+
+std::string
+EntityDiscovery::getNextVersion()
+{
+  ostringstream version;
+  version << ++entityVersion_;
+  return version.str();
+}
+
+std::string
+EntityDiscovery::getRandomHostId()
+{
+  uint8_t random[8];
+  RAND_bytes(random, sizeof(random));
+  
+  static const char *hex = "0123456789abcdef";
+  string hostId;
+  for (size_t i = 0; i < sizeof(random); ++i) {
+    hostId += hex[random[i] >> 4];
+    hostId += hex[random[i] & 0x0F];
+  }
+  return hostId;
 }
 
 void 
@@ -375,14 +929,17 @@ EntityDiscovery::notifyObserver(MessageTypes type, const char *msg, double times
 std::string
 EntityDiscovery::entitiesToString()
 {
-  std::string result;
-  for(std::map<string, ptr_lib::shared_ptr<EntityInfoBase>>::iterator it = discoveredEntityList_.begin(); it != discoveredEntityList_.end(); ++it) {
-    result += it->first;
-    result += "\n";
-  }
-  for(std::map<string, ptr_lib::shared_ptr<EntityInfoBase>>::iterator it = hostedEntityList_.begin(); it != hostedEntityList_.end(); ++it) {
-    result += (" * " + it->first);
-    result += "\n";
+  std::string discovered;
+  std::string hosted;
+  for (EntityTable::iterator it = entities_.begin(); it != entities_.end(); ++it) {
+    if (it->second.state_ == EntityState::DISCOVERED) {
+      discovered += nameTable_->get(it->first);
+      discovered += "\n";
+    }
+    else if (it->second.state_ == EntityState::HOSTED) {
+      hosted += (" * " + nameTable_->get(it->first));
+      hosted += "\n";
+    }
   }
-  return result;
-}
\ No newline at end of file
+  return discovered + hosted;
+}
@@ -0,0 +1,183 @@
+#include "heartbeat-engine.h"
+#include <openssl/rand.h>
+#include <cmath>
+
+using namespace std;
+using namespace ndn;
+using namespace ndn::func_lib;
+using namespace entity_discovery;
+using namespace ndnrtc_addon;
+
+HeartbeatEngine::HeartbeatEngine
+  (Scheduler& scheduler, const OnHeartbeatDue& onHeartbeatDue, size_t window,
+   Milliseconds bucketWidth, double jitter)
+: scheduler_(scheduler), onHeartbeatDue_(onHeartbeatDue), window_(window),
+  bucketWidth_(bucketWidth > 0 ? bucketWidth : 1), jitter_(jitter), inFlightCount_(0),
+  generation_(0), random_(0), latencyHistogram_(0)
+{
+  RAND_bytes((uint8_t *)&random_, sizeof(random_));
+  resetMetrics();
+}
+
+void
+HeartbeatEngine::schedule(NameTable::Id entity, Milliseconds delay)
+{
+  Entry& entry = entries_[entity];
+  if (entry.state_ == State::IN_FLIGHT) {
+    // Its interest is still out, and the answer is matched to this send
+    entry.isRescheduled_ = true;
+    entry.rescheduleTime_ = scheduler_.getNowMilliseconds() + delay;
+    return;
+  }
+
+  if (jitter_ > 0) {
+    // splitmix64 step, scaled to [-1, 1)
+    uint64_t value = (random_ += 0x9e3779b97f4a7c15ULL);
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    delay += delay * jitter_ * ((double)(value >> 11) / (double)(1ULL << 52) - 1);
+  }
+
+  MillisecondsSince1970 now = scheduler_.getNowMilliseconds();
+  uint64_t bucket = (uint64_t)::ceil((now + delay) / bucketWidth_);
+
+  entry.state_ = State::SCHEDULED;
+  entry.generation_ = ++generation_;
+
+  Bucket& slots = buckets_[bucket];
+  if (slots.slots_.empty()) {
+    slots.event_ = scheduler_.schedule
+      (bucket * bucketWidth_ - now, bind(&HeartbeatEngine::onBucketDue, this, bucket));
+  }
+  slots.slots_.push_back(Slot(entity, entry.generation_));
+}
+
+void
+HeartbeatEngine::cancel(NameTable::Id entity)
+{
+  unordered_map<NameTable::Id, Entry>::iterator item = entries_.find(entity);
+  if (item == entries_.end()) {
+    return;
+  }
+  bool wasInFlight = item->second.state_ == State::IN_FLIGHT;
+  // Its bucket and queue slots no longer match a generation, and get skipped
+  entries_.erase(item);
+  if (wasInFlight) {
+    --inFlightCount_;
+    sendReady();
+  }
+}
+
+void
+HeartbeatEngine::onHeartbeatDone(NameTable::Id entity, bool isAnswered)
+{
+  unordered_map<NameTable::Id, Entry>::iterator item = entries_.find(entity);
+  if (item == entries_.end() || item->second.state_ != State::IN_FLIGHT) {
+    return;
+  }
+
+  if (isAnswered) {
+    Milliseconds latency = scheduler_.getNowMilliseconds() - item->second.sendTime_;
+    ++answeredCount_;
+    latencySum_ += latency;
+    if (latency > maxLatency_) {
+      maxLatency_ = latency;
+    }
+    if (latencyHistogram_) {
+      latencyHistogram_->record((uint64_t)(latency * 1000));
+    }
+  }
+  else {
+    ++timedOutCount_;
+  }
+
+  bool isRescheduled = item->second.isRescheduled_;
+  MillisecondsSince1970 rescheduleTime = item->second.rescheduleTime_;
+  entries_.erase(item);
+  --inFlightCount_;
+  if (isRescheduled) {
+    Milliseconds delay = rescheduleTime - scheduler_.getNowMilliseconds();
+    schedule(entity, delay > 0 ? delay : 0);
+  }
+  sendReady();
+}
+
+void
+HeartbeatEngine::shutdown()
+{
+  for (map<uint64_t, Bucket>::iterator it = buckets_.begin(); it != buckets_.end(); ++it) {
+    it->second.event_.cancel();
+  }
+  buckets_.clear();
+  ready_.clear();
+  entries_.clear();
+  inFlightCount_ = 0;
+}
+
+double
+HeartbeatEngine::getSendRate() const
+{
+  Milliseconds elapsed = scheduler_.getNowMilliseconds() - metricsStartTime_;
+  return elapsed <= 0 ? 0 : sentCount_ * 1000.0 / elapsed;
+}
+
+void
+HeartbeatEngine::resetMetrics()
+{
+  metricsStartTime_ = scheduler_.getNowMilliseconds();
+  sentCount_ = 0;
+  answeredCount_ = 0;
+  timedOutCount_ = 0;
+  deferredCount_ = 0;
+  latencySum_ = 0;
+  maxLatency_ = 0;
+}
+
+void
+HeartbeatEngine::onBucketDue(uint64_t bucket)
+{
+  map<uint64_t, Bucket>::iterator item = buckets_.find(bucket);
+  if (item == buckets_.end()) {
+    return;
+  }
+  vector<Slot> slots;
+  slots.swap(item->second.slots_);
+  buckets_.erase(item);
+
+  size_t dueCount = 0;
+  for (size_t i = 0; i < slots.size(); ++i) {
+    unordered_map<NameTable::Id, Entry>::iterator entry = entries_.find(slots[i].first);
+    if (entry != entries_.end() && entry->second.generation_ == slots[i].second) {
+      entry->second.state_ = State::READY;
+      ready_.push_back(slots[i]);
+      ++dueCount;
+    }
+  }
+
+  sendReady();
+  // The queue is sent in order, so what's left of it is the newest
+  deferredCount_ += ready_.size() < dueCount ? ready_.size() : dueCount;
+}
+
+void
+HeartbeatEngine::sendReady()
+{
+  while (!ready_.empty() && (window_ == 0 || inFlightCount_ < window_)) {
+    Slot slot = ready_.front();
+    ready_.pop_front();
+
+    unordered_map<NameTable::Id, Entry>::iterator entry = entries_.find(slot.first);
+    if (entry == entries_.end() || entry->second.generation_ != slot.second ||
+        entry->second.state_ != State::READY) {
+      continue;
+    }
+    entry->second.state_ = State::IN_FLIGHT;
+    entry->second.sendTime_ = scheduler_.getNowMilliseconds();
+    ++inFlightCount_;
+    ++sentCount_;
+
+    // onHeartbeatDue may call back into the engine, so don't hold on to entry
+    onHeartbeatDue_(slot.first);
+  }
+}
@@ -0,0 +1,129 @@
+#include "name-table.h"
+#include <cstring>
+
+using namespace std;
+using namespace entity_discovery;
+
+const NameTable::Id NameTable::NONE;
+const NameTable::Id NameTable::REMOVED;
+
+NameTable::NameTable()
+: slots_(16, NONE), size_(0), usedSlots_(0)
+{
+}
+
+uint64_t
+NameTable::hash(const char *name, size_t nameLength)
+{
+  // 64-bit FNV-1a
+  uint64_t value = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < nameLength; ++i) {
+    value ^= (uint8_t)name[i];
+    value *= 0x100000001b3ULL;
+  }
+  return value;
+}
+
+size_t
+NameTable::findSlot(const char *name, size_t nameLength, uint64_t hash) const
+{
+  size_t mask = slots_.size() - 1;
+  size_t freeSlot = slots_.size();
+  for (size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+    Id id = slots_[slot];
+    if (id == NONE) {
+      // Reuse the first removed slot on the way, if any
+      return freeSlot < slots_.size() ? freeSlot : slot;
+    }
+    if (id == REMOVED) {
+      if (freeSlot == slots_.size()) {
+        freeSlot = slot;
+      }
+      continue;
+    }
+    const Entry& entry = entries_[id];
+    if (entry.hash_ == hash && entry.name_.size() == nameLength &&
+        memcmp(entry.name_.data(), name, nameLength) == 0) {
+      return slot;
+    }
+  }
+}
+
+NameTable::Id
+NameTable::find(const char *name, size_t nameLength) const
+{
+  Id id = slots_[findSlot(name, nameLength, hash(name, nameLength))];
+  return id == REMOVED ? NONE : id;
+}
+
+NameTable::Id
+NameTable::intern(const string& name)
+{
+  uint64_t nameHash = hash(name.data(), name.size());
+  size_t slot = findSlot(name.data(), name.size(), nameHash);
+  Id id = slots_[slot];
+  if (id != NONE && id != REMOVED) {
+    ++entries_[id].refCount_;
+    return id;
+  }
+
+  if (freeIds_.empty()) {
+    id = (Id)entries_.size();
+    entries_.push_back(Entry());
+  }
+  else {
+    id = freeIds_.back();
+    freeIds_.pop_back();
+  }
+  Entry& entry = entries_[id];
+  entry.name_ = name;
+  entry.hash_ = nameHash;
+  entry.refCount_ = 1;
+
+  if (slots_[slot] == NONE) {
+    ++usedSlots_;
+  }
+  slots_[slot] = id;
+  ++size_;
+
+  // Keep probe sequences short, counting removed slots as used
+  if (usedSlots_ * 4 > slots_.size() * 3) {
+    resize(size_ * 4 > slots_.size() ? slots_.size() * 2 : slots_.size());
+  }
+  return id;
+}
+
+void
+NameTable::release(Id id)
+{
+  Entry& entry = entries_[id];
+  if (--entry.refCount_ > 0) {
+    return;
+  }
+
+  slots_[findSlot(entry.name_.data(), entry.name_.size(), entry.hash_)] = REMOVED;
+  // Give the memory of the name back
+  string().swap(entry.name_);
+  freeIds_.push_back(id);
+  --size_;
+}
+
+void
+NameTable::resize(size_t slotCount)
+{
+  vector<Id> slots(slotCount, NONE);
+  size_t mask = slotCount - 1;
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    Id id = slots_[i];
+    if (id == NONE || id == REMOVED) {
+      continue;
+    }
+    size_t slot = entries_[id].hash_ & mask;
+    while (slots[slot] != NONE) {
+      slot = (slot + 1) & mask;
+    }
+    slots[slot] = id;
+  }
+  slots_.swap(slots);
+  usedSlots_ = size_;
+}
@@ -12,6 +12,32 @@ using namespace entity_discovery;
 using namespace func_lib::placeholders;
 #endif
 
+/**
+ * Segment components use the segment marker 0x00 as in Name::appendSegment.
+ */
+static bool
+isSegmentComponent(const Name::Component& component)
+{
+  return component.getValue().size() > 0 && component.getValue().buf()[0] == 0x00;
+}
+
+/**
+ * The digest of a segmented reply, over the content of all its segments in order,
+ * which names its segments.
+ */
+static std::string
+getReplyDigest(const std::vector<Blob>& segments)
+{
+  SHA256_CTX sha256;
+  SHA256_Init(&sha256);
+  for (size_t i = 0; i < segments.size(); ++i) {
+    SHA256_Update(&sha256, segments[i].buf(), segments[i].size());
+  }
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  SHA256_Final(&digest[0], &sha256);
+  return toHex(digest, sizeof(digest));
+}
+
 void 
 SyncBasedDiscovery::onData
   (const ptr_lib::shared_ptr<const Interest>& interest,
@@ -19,38 +45,313 @@ SyncBasedDiscovery::onData
 {
   if (!enabled_)
     return ;
-  string content;
-  for (size_t i = 0; i < data->getContent().size(); ++i)
-    content += (*data->getContent())[i];
   
-  vector<std::string> objects = SyncBasedDiscovery::stringToObjects(content);
+  // A reply longer than the interest name, ending in a segment number, is one of 
+  // several segments, unless it's also the last one. Caches answer with any segment 
+  // under the interest name, not only the first
+  if (data->getName().size() > interest->getName().size() &&
+      isSegmentComponent(data->getName().get(-1)) &&
+      data->getMetaInfo().getFinalBlockId().getValue().size() > 0) {
+    uint64_t segment = data->getName().get(-1).toSegment();
+    uint64_t finalSegment = data->getMetaInfo().getFinalBlockId().toSegment();
+    
+    if (segment <= finalSegment && finalSegment > 0) {
+      Name baseName = data->getName().getPrefix(-1);
+      if (segmentFetches_.find(baseName.toUri()) != segmentFetches_.end()) {
+        // The fetch under way gets this segment with its own interests
+        return;
+      }
+      
+      SegmentFetch& fetch = segmentFetches_.insert
+        (std::pair<std::string, SegmentFetch>(baseName.toUri(), SegmentFetch(finalSegment))).first->second;
+      fetch.segments_[segment] = data->getContent();
+      fetch.received_[segment] = true;
+      fetch.receivedCount_ = 1;
+      
+      size_t expressedCount = 0;
+      while (fetch.nextSegment_ <= finalSegment && expressedCount < segmentFetchWindow_) {
+        if (!fetch.received_[fetch.nextSegment_]) {
+          expressSegmentInterest(baseName, fetch.nextSegment_);
+          expressedCount ++;
+        }
+        fetch.nextSegment_ ++;
+      }
+      return;
+    }
+  }
   
-  // Finding vector differences by using existing function, 
-  // which requires both vectors to be sorted.
-  std::sort(objects.begin(), objects.end());
-  std::sort(objects_.begin(), objects_.end());
+  processSyncContent(std::vector<Blob>(1, data->getContent()));
+}
 
-  std::vector<std::string> setDifferences;
+void
+SyncBasedDiscovery::onSegmentData
+  (const ptr_lib::shared_ptr<const Interest>& interest,
+   const ptr_lib::shared_ptr<Data>& data)
+{
+  if (!enabled_)
+    return ;
+  Name baseName = interest->getName().getPrefix(-1);
+  std::map<std::string, SegmentFetch>::iterator item = segmentFetches_.find(baseName.toUri());
+  if (item == segmentFetches_.end()) {
+    return;
+  }
+  SegmentFetch& fetch = item->second;
+  
+  uint64_t segment = interest->getName().get(-1).toSegment();
+  if (segment >= fetch.segments_.size() || fetch.received_[segment]) {
+    return;
+  }
+  // Every segment must be of the reply named by baseName, cut the same way
+  if (!data->getName().equals(interest->getName()) ||
+      data->getMetaInfo().getFinalBlockId().getValue().size() == 0 ||
+      data->getMetaInfo().getFinalBlockId().toSegment() + 1 != fetch.segments_.size()) {
+    segmentFetches_.erase(item);
+    expressBroadcastInterest(interest);
+    return;
+  }
+  
+  fetch.segments_[segment] = data->getContent();
+  fetch.received_[segment] = true;
+  fetch.receivedCount_ ++;
+  fetch.retries_.erase(segment);
+  
+  if (fetch.receivedCount_ == fetch.segments_.size()) {
+    std::vector<Blob> segments = fetch.segments_;
+    segmentFetches_.erase(item);
+    if (getReplyDigest(segments) != baseName.get(-1).toEscapedString()) {
+      // Not the reply its name says; sync again with our current digest
+      expressBroadcastInterest(interest);
+      return;
+    }
+    processSyncContent(segments);
+  }
+  else {
+    while (fetch.nextSegment_ < fetch.segments_.size() && fetch.received_[fetch.nextSegment_]) {
+      fetch.nextSegment_ ++;
+    }
+    if (fetch.nextSegment_ < fetch.segments_.size()) {
+      expressSegmentInterest(baseName, fetch.nextSegment_);
+      fetch.nextSegment_ ++;
+    }
+  }
+}
+
+void
+SyncBasedDiscovery::onSegmentTimeout
+  (const ptr_lib::shared_ptr<const Interest>& interest)
+{
+  if (!enabled_)
+    return ;
+  Name baseName = interest->getName().getPrefix(-1);
+  std::map<std::string, SegmentFetch>::iterator item = segmentFetches_.find(baseName.toUri());
+  if (item == segmentFetches_.end()) {
+    return;
+  }
+  
+  uint64_t segment = interest->getName().get(-1).toSegment();
+  if (item->second.retries_[segment] ++ < maxSegmentRetries_) {
+    expressSegmentInterest(baseName, segment);
+  }
+  else {
+    // Give up on this reply, and sync again with our current digest
+    segmentFetches_.erase(item);
+    expressBroadcastInterest(interest);
+  }
+}
+
+void
+SyncBasedDiscovery::expressSegmentInterest(const Name& baseName, uint64_t segment)
+{
+  Interest interest(Name(baseName).appendSegment(segment));
+  interest.setInterestLifetimeMilliseconds(defaultInterestLifetime_);
+  interest.setMustBeFresh(true);
+  
+  face_.expressInterest
+    (interest, bind(&SyncBasedDiscovery::onSegmentData, shared_from_this(), _1, _2),
+     bind(&SyncBasedDiscovery::onSegmentTimeout, shared_from_this(), _1));
+  interestsSent_.increment();
+}
+
+/**
+ * Compare a name that's not null terminated with a string, like std::string::compare.
+ */
+static int
+compareName(const char *name, size_t nameLength, const std::string& object)
+{
+  int result = memcmp(name, object.data(), std::min(nameLength, object.size()));
+  if (result != 0) {
+    return result;
+  }
+  return nameLength < object.size() ? -1 : (nameLength > object.size() ? 1 : 0);
+}
 
-  std::set_symmetric_difference
-    (objects.begin(),
-     objects.end(),
-     objects_.begin(),
-     objects_.end(),
-     std::back_inserter(setDifferences));
+/**
+ * SyncContentDiffer diffs decoded entries against the sorted local objects as they
+ * are decoded, so that names in the sync reply are only copied if they are differences.
+ * Full object lists are merged with the local objects in one pass, which requires
+ * them to arrive sorted; sorted_ turns false otherwise.
+ */
+class SyncContentDiffer
+{
+public:
+  SyncContentDiffer(const std::vector<NameTable::Id>& objects, const NameTable& nameTable)
+  : objects_(objects), nameTable_(nameTable), next_(0), sorted_(true), isDelta_(false)
+  {}
+  
+  void
+  onEntry(SyncDataCodec::EntryType type, const char *name, size_t nameLength)
+  {
+    if (type != SyncDataCodec::OBJECT) {
+      // The peer knew our digest and replied with the changes since then, so only 
+      // changes that we haven't applied ourselves are differences.
+      isDelta_ = true;
+      if ((type == SyncDataCodec::ADDED) != hasObject(name, nameLength)) {
+        deltaDifferences_.push_back(std::string(name, nameLength));
+      }
+      return;
+    }
+    
+    if (!sorted_) {
+      return;
+    }
+    if (previous_.size() > 0 && compareName(name, nameLength, previous_) <= 0) {
+      sorted_ = false;
+      return;
+    }
+    // previous_ reuses its buffer, so this does not allocate once it's grown
+    previous_.assign(name, nameLength);
+    
+    // Objects only we have come before name
+    while (next_ < objects_.size() && compareName(name, nameLength, getObject(next_)) > 0) {
+      differences_.push_back(getObject(next_));
+      ++next_;
+    }
+    if (next_ < objects_.size() && compareName(name, nameLength, getObject(next_)) == 0) {
+      ++next_;
+    }
+    else {
+      differences_.push_back(previous_);
+    }
+  }
+  
+  /**
+   * Get the differences after every entry is decoded.
+   */
+  void
+  getDifferences(std::vector<std::string>& differences)
+  {
+    if (isDelta_) {
+      differences.swap(deltaDifferences_);
+      return;
+    }
+    // Objects only we have after the last received name
+    for (; next_ < objects_.size(); ++next_) {
+      differences_.push_back(getObject(next_));
+    }
+    differences.swap(differences_);
+  }
+  
+  bool
+  isSorted() { return sorted_ || isDelta_; }
+  
+private:
+  const std::string&
+  getObject(size_t i) { return nameTable_.get(objects_[i]); }
+  
+  bool
+  hasObject(const char *name, size_t nameLength)
+  {
+    size_t low = 0;
+    size_t high = objects_.size();
+    while (low < high) {
+      size_t middle = low + (high - low) / 2;
+      int result = compareName(name, nameLength, getObject(middle));
+      if (result == 0) {
+        return true;
+      }
+      if (result > 0) {
+        low = middle + 1;
+      }
+      else {
+        high = middle;
+      }
+    }
+    return false;
+  }
+  
+  const std::vector<NameTable::Id>& objects_;
+  const NameTable& nameTable_;
+  size_t next_;
+  std::string previous_;
+  bool sorted_;
+  bool isDelta_;
+  std::vector<std::string> differences_;
+  std::vector<std::string> deltaDifferences_;
+};
+
+/**
+ * Collects decoded full list entries, for lists that did not arrive sorted.
+ */
+static void
+collectSyncObject
+  (SyncDataCodec::EntryType type, const char *name, size_t nameLength,
+   std::vector<std::string>& objects)
+{
+  if (type == SyncDataCodec::OBJECT) {
+    objects.push_back(std::string(name, nameLength));
+  }
+}
+
+void
+SyncBasedDiscovery::processSyncContent(const std::vector<Blob>& segments)
+{
+  std::vector<std::string> setDifferences;
+  
+  // Decoding works directly on the packet buffers
+  SyncContentDiffer differ(objects_, *nameTable_);
+  bool malformed = false;
+  for (size_t i = 0; i < segments.size() && !malformed; ++i) {
+    malformed = !SyncDataCodec::decode
+      (segments[i], bind(&SyncContentDiffer::onEntry, &differ, _1, _2, _3));
+  }
+  
+  if (malformed) {
+    cerr << "Received malformed sync data." << endl;
+  }
+  else if (differ.isSorted()) {
+    differ.getDifferences(setDifferences);
+  }
+  else {
+    // Peers send their objects in sorted order, so this should not happen
+    std::vector<std::string> objects;
+    for (size_t i = 0; i < segments.size(); ++i) {
+      SyncDataCodec::decode
+        (segments[i], bind(&collectSyncObject, _1, _2, _3, ndn::func_lib::ref(objects)));
+    }
+    std::sort(objects.begin(), objects.end());
+    objects.erase(std::unique(objects.begin(), objects.end()), objects.end());
+    
+    // Finding vector differences by using existing function, 
+    // which requires both vectors to be sorted.
+    std::vector<std::string> localObjects = getObjects();
+    std::set_symmetric_difference
+      (objects.begin(),
+       objects.end(),
+       localObjects.begin(),
+       localObjects.end(),
+       std::back_inserter(setDifferences));
+  }
   
   onReceivedSyncData_(setDifferences);
   
   // Express interest again immediately may not be the best idea...
   // Try expressing in a given timeout period: 
   // Why it does not work as expected, without this interval?
-  
-  Interest timeout("/local/timeout");
-  timeout.setInterestLifetimeMilliseconds(defaultInterestLifetime_);
-  
-  face_.expressInterest
-    (timeout, bind(&SyncBasedDiscovery::dummyOnData, shared_from_this(), _1, _2),
-     bind(&SyncBasedDiscovery::expressBroadcastInterest, shared_from_this(), _1));
+  broadcastEvent_.cancel();
+  broadcastEvent_ = scheduler_.schedule
+    (defaultInterestLifetime_, 
+     bind(&SyncBasedDiscovery::expressBroadcastInterest, shared_from_this(), 
+          ptr_lib::shared_ptr<const Interest>()));
   return;
 }
 
@@ -58,28 +359,17 @@ void
 SyncBasedDiscovery::expressBroadcastInterest
   (const ptr_lib::shared_ptr<const Interest>& interest)
 {
-  Name name(broadcastPrefix_);
-  name.append(currentDigest_);
-
-  Interest newInterest(name);
+  broadcastEvent_.cancel();
+  face_.removePendingInterest(broadcastInterestId_);
+  
+  Interest newInterest(getBroadcastInterestName());
   newInterest.setInterestLifetimeMilliseconds(defaultInterestLifetime_);
   newInterest.setMustBeFresh(true);
   
-  face_.expressInterest
+  broadcastInterestId_ = face_.expressInterest
     (newInterest, bind(&SyncBasedDiscovery::onData, shared_from_this(), _1, _2),
      bind(&SyncBasedDiscovery::onTimeout, shared_from_this(), _1));
-  return;
-}
-
-void 
-SyncBasedDiscovery::dummyOnData
-  (const ptr_lib::shared_ptr<const Interest>& interest,
-   const ptr_lib::shared_ptr<Data>& data)
-{
-  if (!enabled_)
-    return ;
-  cerr << "Dummy onData called." << endl;
-  throw std::runtime_error("Discovery library called dummyOnData, which shouldn't be called in any case.\n");
+  interestsSent_.increment();
   return;
 }
 
@@ -89,16 +379,7 @@ SyncBasedDiscovery::onTimeout
 {
   if (!enabled_)
     return ;
-  Name interestName(broadcastPrefix_);
-  interestName.append(currentDigest_);
-  
-  Interest newInterest(interestName);
-  newInterest.setInterestLifetimeMilliseconds(defaultInterestLifetime_);
-  newInterest.setMustBeFresh(true);
-
-  face_.expressInterest
-    (newInterest, bind(&SyncBasedDiscovery::onData, shared_from_this(), _1, _2), 
-     bind(&SyncBasedDiscovery::onTimeout, shared_from_this(), _1));
+  expressBroadcastInterest(interest);
 }
 
 void 
@@ -109,31 +390,56 @@ SyncBasedDiscovery::onInterestCallback
 {
   if (!enabled_)
     return ;
+  interestsReceived_.increment();
   string syncDigest = interest->getName().get
     (broadcastPrefix_.size()).toEscapedString();
+  
+  // Segment interests are <syncDigest>[/<IBLT>]/<digest of the reply>/<segment>
+  if (interest->getName().size() > broadcastPrefix_.size() + 2 &&
+      isSegmentComponent(interest->getName().get(-1))) {
+    // A segment of a segmented reply, whose segments were not in contentCache_ (anymore).
+    // It's answered only if the reply made again is the same, down to its encoding; 
+    // otherwise the requester gives up on this one and syncs again
+    uint64_t segment = interest->getName().get(-1).toSegment();
+    std::vector<ptr_lib::shared_ptr<Data> > segments = getSyncReply
+      (interest->getName().getPrefix(-2));
     
+    for (size_t i = 0; i < segments.size(); ++i) {
+      contentCache_.add(*segments[i]);
+    }
+    if (segment < segments.size() && segments[segment]->getName().equals(interest->getName())) {
+      face.putData(*segments[segment]);
+    }
+    return;
+  }
+  
   if (syncDigest != currentDigest_) {
-    // the syncDigest differs from the local knowledge, reply with local knowledge
-    // We don't have digestLog implemented in this, so incremental replying is not considered now
+    // the syncDigest differs from the local knowledge, reply with local knowledge;
+    // incrementally if syncDigest is in the digest log
     
     // It could potentially cause one name corresponds with different data in different locations,
     // Same as publishing two conferences simultaneously: such errors should be correctible
     // later steps
-    Data data(interest->getName());
-    std::string content = objectsToString();
+    // Requesters with the same digest get the same reply, which is signed once.
+    std::vector<ptr_lib::shared_ptr<Data> > segments = getSyncReply(interest->getName());
     
-    data.setContent((const uint8_t *)&content[0], content.size());
-    
-    data.getMetaInfo().setFreshnessPeriod(defaultDataFreshnessPeriod_);
-    
-    keyChain_.sign(data, certificateName_);
-    face.putData(data);
+    // Later segments are served from contentCache_ as the requester fetches them. The
+    // first one is cached too, since contentCache_ answers later interests for this name
+    // with any of them
+    for (size_t i = 0; i < segments.size(); ++i) {
+      contentCache_.add(*segments[i]);
+    }
+    face.putData(*segments[0]);
   }
   else if (syncDigest != newComerDigest_) {
     // Store this steady-state (outstanding) interest in application PIT, unless neither the sender
     // nor receiver knows anything
-    pendingInterestTable_.push_back(ptr_lib::shared_ptr<PendingInterest>
-      (new PendingInterest(interest, face)));
+    // A duplicate is not added, so that it's not answered twice
+    pendingInterestTable_.add
+      (ptr_lib::shared_ptr<PendingInterest>
+         (new PendingInterest(interest, face, scheduler_.getNowMilliseconds())), 
+       scheduler_.getNowMilliseconds());
+    pitSize_.set(pendingInterestTable_.size());
   }
 }
 
@@ -153,17 +459,226 @@ SyncBasedDiscovery::onRegisterFailed
 void
 SyncBasedDiscovery::recomputeDigest()
 {
+  digestRecomputations_.increment();
+  if (digestType_ == SyncDigestType::INCREMENTAL) {
+    setCurrentDigest(toHex(digestAccumulator_, sizeof(digestAccumulator_)));
+    return;
+  }
+  
   SHA256_CTX sha256;
   SHA256_Init(&sha256);
   
-  for (std::vector<std::string>::iterator it = objects_.begin(); it != objects_.end(); ++it) {
-    SHA256_Update(&sha256, &((*it)[0]), it->size());
+  for (std::vector<NameTable::Id>::iterator it = objects_.begin(); it != objects_.end(); ++it) {
+    const std::string& object = nameTable_->get(*it);
+    SHA256_Update(&sha256, object.data(), object.size());
   }
   
   uint8_t currentDigest[SHA256_DIGEST_LENGTH];
   SHA256_Final(&currentDigest[0], &sha256);
   
-  currentDigest_ = toHex(currentDigest, sizeof(currentDigest));
+  setCurrentDigest(toHex(currentDigest, sizeof(currentDigest)));
+}
+
+void
+SyncBasedDiscovery::setCurrentDigest(const std::string& digest)
+{
+  if (digestLogLength_ > 0 && digest != currentDigest_ && pendingChanges_.size() > 0) {
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+    for (std::map<std::string, bool>::iterator it = pendingChanges_.begin(); it != pendingChanges_.end(); ++it) {
+      if (it->second) {
+        added.push_back(it->first);
+      }
+      else {
+        removed.push_back(it->first);
+      }
+    }
+    digestLog_.push_back(DigestLogEntry(currentDigest_, added, removed));
+    while (digestLog_.size() > digestLogLength_) {
+      digestLog_.pop_front();
+    }
+  }
+  pendingChanges_.clear();
+  
+  // The outstanding broadcast interest names the old digest. It's replaced once the 
+  // changes that follow are done, or by onPublished before that
+  if (enabled_ && digest != currentDigest_) {
+    broadcastEvent_.cancel();
+    broadcastEvent_ = scheduler_.schedule
+      (digestChangeDelay_, bind(&SyncBasedDiscovery::expressBroadcastInterest, shared_from_this(), 
+               ptr_lib::shared_ptr<const Interest>()));
+  }
+  currentDigest_ = digest;
+}
+
+void
+SyncBasedDiscovery::recordPendingChange(const std::string& object, bool added)
+{
+  std::map<std::string, bool>::iterator item = pendingChanges_.find(object);
+  if (item == pendingChanges_.end()) {
+    pendingChanges_[object] = added;
+  }
+  else if (item->second != added) {
+    pendingChanges_.erase(item);
+  }
+}
+
+std::vector<SyncDataCodec::Entry>
+SyncBasedDiscovery::syncEntriesSince(const std::string& fromDigest)
+{
+  std::vector<SyncDataCodec::Entry> entries;
+  
+  if (digestLogLength_ == 0 || fromDigest == newComerDigest_) {
+    for (size_t i = 0; i < objects_.size(); ++i) {
+      entries.push_back(SyncDataCodec::Entry(SyncDataCodec::OBJECT, nameTable_->get(objects_[i])));
+    }
+    return entries;
+  }
+  
+  // The digest may have been visited more than once, the latest visit is the one 
+  // with the fewest changes since.
+  int start = (int)digestLog_.size() - 1;
+  while (start >= 0 && digestLog_[start].getDigest() != fromDigest) {
+    --start;
+  }
+  if (start < 0) {
+    return syncEntriesSince(newComerDigest_);
+  }
+  
+  // Compose the changes of this and every later entry; true for added, false for removed.
+  std::map<std::string, bool> changes;
+  for (size_t i = start; i < digestLog_.size(); ++i) {
+    for (size_t j = 0; j < digestLog_[i].getAdded().size(); ++j) {
+      const std::string& object = digestLog_[i].getAdded()[j];
+      std::map<std::string, bool>::iterator item = changes.find(object);
+      if (item != changes.end() && !item->second) {
+        changes.erase(item);
+      }
+      else {
+        changes[object] = true;
+      }
+    }
+    for (size_t j = 0; j < digestLog_[i].getRemoved().size(); ++j) {
+      const std::string& object = digestLog_[i].getRemoved()[j];
+      std::map<std::string, bool>::iterator item = changes.find(object);
+      if (item != changes.end() && item->second) {
+        changes.erase(item);
+      }
+      else {
+        changes[object] = false;
+      }
+    }
+  }
+  
+  // A delta as large as the full list is no better than the full list, 
+  // and an empty delta would be read as an empty object list.
+  if (changes.size() == 0 || changes.size() >= objects_.size()) {
+    return syncEntriesSince(newComerDigest_);
+  }
+  
+  for (std::map<std::string, bool>::iterator it = changes.begin(); it != changes.end(); ++it) {
+    entries.push_back(SyncDataCodec::Entry
+      (it->second ? SyncDataCodec::ADDED : SyncDataCodec::REMOVED, it->first));
+  }
+  return entries;
+}
+
+std::vector<SyncDataCodec::Entry>
+SyncBasedDiscovery::syncEntriesFor(const Name& name)
+{
+  std::string syncDigest = name.get(broadcastPrefix_.size()).toEscapedString();
+  
+  SyncIblt remoteIblt;
+  if (name.size() > broadcastPrefix_.size() + 1 &&
+      SyncIblt::decode(name.get(broadcastPrefix_.size() + 1).getValue(), remoteIblt)) {
+    // Our table must have as many cells as the requester's; if IBLT is disabled 
+    // here, or configured differently, build it for this reply.
+    std::map<uint64_t, NameTable::Id> localKeys;
+    const std::map<uint64_t, NameTable::Id> *keys = &ibltKeys_;
+    SyncIblt difference = iblt_;
+    if (ibltCellCount_ == 0 || iblt_.getCellCount() != remoteIblt.getCellCount()) {
+      difference = SyncIblt(remoteIblt.getCellCount());
+      for (size_t i = 0; i < objects_.size(); ++i) {
+        uint64_t key = SyncIblt::getKey(nameTable_->get(objects_[i]));
+        difference.insert(key);
+        localKeys[key] = objects_[i];
+      }
+      keys = &localKeys;
+    }
+    difference.subtract(remoteIblt);
+    
+    std::vector<uint64_t> localOnly;
+    std::vector<uint64_t> remoteOnly;
+    if (difference.listEntries(localOnly, remoteOnly)) {
+      // Objects the requester has and we don't can't be named from their keys, 
+      // so the reply only has the objects it lacks.
+      std::vector<std::string> added;
+      for (size_t i = 0; i < localOnly.size(); ++i) {
+        std::map<uint64_t, NameTable::Id>::const_iterator item = keys->find(localOnly[i]);
+        if (item != keys->end()) {
+          added.push_back(nameTable_->get(item->second));
+        }
+      }
+      if (added.size() > 0) {
+        std::sort(added.begin(), added.end());
+        std::vector<SyncDataCodec::Entry> entries;
+        for (size_t i = 0; i < added.size(); ++i) {
+          entries.push_back(SyncDataCodec::Entry(SyncDataCodec::ADDED, added[i]));
+        }
+        return entries;
+      }
+      // The requester seems to lack nothing, yet its digest differs: it may have
+      // more objects, or our keys may collide. Reply as without IBLT, so that it 
+      // still hears from us.
+    }
+    // Otherwise the difference is too large for the table
+  }
+  
+  return syncEntriesSince(syncDigest);
+}
+
+std::vector<ptr_lib::shared_ptr<Data> >
+SyncBasedDiscovery::getSyncReply(const Name& name)
+{
+  std::string key = name.toUri();
+  std::unordered_map<std::string, std::vector<ptr_lib::shared_ptr<Data> > >::iterator item = 
+    replyCache_.find(key);
+  if (item != replyCache_.end()) {
+    return item->second;
+  }
+  
+  std::vector<ptr_lib::shared_ptr<Data> > segments = makeSyncData(name, syncEntriesFor(name));
+  
+  // Evict the oldest reply; IBLT interests have a name per requester
+  if (replyCacheOrder_.size() >= maxReplyCacheSize_) {
+    replyCache_.erase(replyCacheOrder_.front());
+    replyCacheOrder_.pop_front();
+  }
+  replyCache_[key] = segments;
+  replyCacheOrder_.push_back(key);
+  return segments;
+}
+
+Name
+SyncBasedDiscovery::getBroadcastInterestName()
+{
+  Name name(broadcastPrefix_);
+  name.append(currentDigest_);
+  if (ibltCellCount_ > 0 && currentDigest_ != newComerDigest_) {
+    name.append(iblt_.encode());
+  }
+  return name;
+}
+
+void
+SyncBasedDiscovery::updateDigestAccumulator(const std::string& object)
+{
+  uint8_t objectDigest[SHA256_DIGEST_LENGTH];
+  SHA256((const uint8_t *)object.data(), object.size(), objectDigest);
+  
+  for (size_t i = 0; i < sizeof(digestAccumulator_); ++i) {
+    digestAccumulator_[i] ^= objectDigest[i];
+  }
 }
 
 void
@@ -178,45 +693,105 @@ SyncBasedDiscovery::stopPublishingObject(std::string name)
   return removeObject(name, true);
 }
 
+size_t
+SyncBasedDiscovery::stopPublishingObjects(const std::vector<std::string>& names)
+{
+  size_t removedCount = 0;
+  for (size_t i = 0; i < names.size(); ++i) {
+    removedCount += removeObject(names[i], false);
+  }
+  if (removedCount > 0) {
+    recomputeDigest();
+  }
+  return removedCount;
+}
+
 void
 SyncBasedDiscovery::publishObject(std::string name)
 {
-  // addObject sorts the objects array
-  // Here using addObject without updating hash immediately, because we want the content cache
-  // to store the data {name: old digest, content: the new dataset}
-  // We update hash and express interest about the new hash after 
-  // storing the above mentioned stuff in the content cache
+  // addObject keeps the objects array sorted
+  std::string oldDigest = currentDigest_;
+  
+  if (addObject(name, true)) {
+    onPublished(oldDigest);
+  }
+  else {
+    cerr << "Object already exists." << endl;
+  }
+}
+
+size_t
+SyncBasedDiscovery::publishObjects(const std::vector<std::string>& names)
+{
+  std::string oldDigest = currentDigest_;
   
-  if (addObject(name, false)) {
+  size_t addedCount = 0;
+  for (size_t i = 0; i < names.size(); ++i) {
+    addedCount += addObject(names[i], false);
+  }
+  if (addedCount > 0) {
+    recomputeDigest();
+    onPublished(oldDigest);
+  }
+  return addedCount;
+}
+
+void
+SyncBasedDiscovery::onPublished(const std::string& oldDigest)
+{
+  // We want the content cache to store the data {name: old digest, content: the new dataset},
+  // which is the delta since the old digest if digest log is enabled.
+  // We express interest about the new hash after storing the above mentioned stuff 
+  // in the content cache
   
-    // Do not add itself to contentCache if its currentDigest is "00".
-    if (currentDigest_ != newComerDigest_) {
-      Name dataName = Name(broadcastPrefix_).append(currentDigest_);
-      Data data(dataName);
-    
-      std::string content = objectsToString();
-      data.setContent((const uint8_t *)&content[0], content.size());
-      data.getMetaInfo().setFreshnessPeriod(defaultDataFreshnessPeriod_);
+  // Do not add itself to contentCache if its currentDigest is "00".
+  if (oldDigest != newComerDigest_) {
+    std::vector<ptr_lib::shared_ptr<Data> > segments = getSyncReply
+      (Name(broadcastPrefix_).append(oldDigest));
     
-      keyChain_.sign(data, certificateName_);
-    
-      contentCacheAdd(data);
+    // The first segment satisfies the pending interests
+    for (size_t i = 0; i < segments.size(); ++i) {
+      contentCacheAdd(*segments[i]);
     }
-    
-    recomputeDigest();
-    
-    Name interestName = Name(broadcastPrefix_).append(currentDigest_);
-    Interest interest(interestName);
-    interest.setInterestLifetimeMilliseconds(defaultInterestLifetime_);
-    interest.setMustBeFresh(true);
-    
-    face_.expressInterest
-      (interest, bind(&SyncBasedDiscovery::onData, shared_from_this(), _1, _2), 
-       bind(&SyncBasedDiscovery::onTimeout, shared_from_this(), _1));
+    satisfyPendingIbltInterests(oldDigest);
   }
-  else {
-    cerr << "Object already exists." << endl;
+  
+  // The interest for the new digest replaces the one for the old
+  expressBroadcastInterest(ptr_lib::shared_ptr<const Interest>());
+}
+
+std::vector<ptr_lib::shared_ptr<Data> >
+SyncBasedDiscovery::makeSyncData
+  (const Name& name, const std::vector<SyncDataCodec::Entry>& entries)
+{
+  std::vector<Blob> chunks;
+  size_t next = 0;
+  do {
+    std::string chunk;
+    next = SyncDataCodec::encode(dataFormat_, entries, next, maxSegmentSize_, chunk);
+    chunks.push_back(Blob((const uint8_t *)chunk.data(), chunk.size()));
+  } while (next < entries.size());
+  
+  std::string replyDigest;
+  if (chunks.size() > 1) {
+    replyDigest = getReplyDigest(chunks);
+  }
+  
+  std::vector<ptr_lib::shared_ptr<Data> > segments;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    ptr_lib::shared_ptr<Data> data(new Data(name));
+    if (chunks.size() > 1) {
+      data->getName().append(replyDigest).appendSegment(i);
+      data->getMetaInfo().setFinalBlockId(Name().appendSegment(chunks.size() - 1).get(0));
+    }
+    data->setContent(chunks[i]);
+    data->getMetaInfo().setFreshnessPeriod(defaultDataFreshnessPeriod_);
+    
+    keyChain_.sign(*data, certificateName_);
+    dataSigned_.increment();
+    segments.push_back(data);
   }
+  return segments;
 }
 
 void
@@ -224,43 +799,224 @@ SyncBasedDiscovery::contentCacheAdd(const Data& data)
 {
   contentCache_.add(data);
 
-  // Remove timed-out interests and check if the data packet matches any pending
-  // interest.
-  // Go backwards through the list so we can erase entries.
-  MillisecondsSince1970 nowMilliseconds = ndn_getNowMilliseconds();
-  for (int i = (int)pendingInterestTable_.size() - 1; i >= 0; --i) {
-    if (pendingInterestTable_[i]->isTimedOut(nowMilliseconds)) {
-      pendingInterestTable_.erase(pendingInterestTable_.begin() + i);
+  // Extract the pending interests the data packet satisfies; this also
+  // removes timed-out interests.
+  std::vector<ptr_lib::shared_ptr<PendingInterest> > satisfied;
+  pendingInterestTable_.extractMatching(data.getName(), scheduler_.getNowMilliseconds(), satisfied);
+  pitSize_.set(pendingInterestTable_.size());
+  if (satisfied.size() == 0) {
+    return;
+  }
+  
+  // Encode once, and send once to each face: one data packet satisfies every
+  // interest it matches that came from the same face.
+  Blob encoding = data.wireEncode();
+  std::set<Face*> faces;
+  for (size_t i = 0; i < satisfied.size(); ++i) {
+    if (!faces.insert(&satisfied[i]->getFace()).second) {
       continue;
     }
+    try {
+      // Send to the same transport from the original call to onInterest.
+      satisfied[i]->getFace().send(encoding);
+    }
+    catch (std::exception& e) {
+      // print the error message and throw again.
+      cerr << e.what() << endl;
+      throw;
+    }
+  }
+}
 
-    if (pendingInterestTable_[i]->getInterest()->matchesName(data.getName())) {
-      try {
-        // Send to the same transport from the original call to onInterest.
-        // wireEncode returns the cached encoding if available.
-        pendingInterestTable_[i]->getFace().putData(data);
-      }
-      catch (std::exception& e) {
-        // print the error message and throw again.
-        cerr << e.what() << endl;
-        throw;
-      }
-
-      // The pending interest is satisfied, so remove it.
-      pendingInterestTable_.erase(pendingInterestTable_.begin() + i);
+void
+SyncBasedDiscovery::satisfyPendingIbltInterests(const std::string& digest)
+{
+  // Interests for digest without IBLT were already satisfied by contentCacheAdd
+  std::vector<ptr_lib::shared_ptr<PendingInterest> > pendingInterests;
+  pendingInterestTable_.extract
+    (Name(broadcastPrefix_).append(digest), scheduler_.getNowMilliseconds(), pendingInterests);
+  pitSize_.set(pendingInterestTable_.size());
+  
+  for (size_t i = 0; i < pendingInterests.size(); ++i) {
+    std::vector<ptr_lib::shared_ptr<Data> > segments = getSyncReply
+      (pendingInterests[i]->getInterest()->getName());
+    for (size_t j = 0; j < segments.size(); ++j) {
+      contentCache_.add(*segments[j]);
     }
+    pendingInterests[i]->getFace().putData(*segments[0]);
   }
 }
 
 SyncBasedDiscovery::PendingInterest::PendingInterest
-  (const ptr_lib::shared_ptr<const Interest>& interest, Face& face)
+  (const ptr_lib::shared_ptr<const Interest>& interest, Face& face, 
+   MillisecondsSince1970 nowMilliseconds)
   : interest_(interest), face_(face)
 {
   // Set up timeoutTime_.
   if (interest_->getInterestLifetimeMilliseconds() >= 0.0)
-    timeoutTimeMilliseconds_ = ndn_getNowMilliseconds() +
+    timeoutTimeMilliseconds_ = nowMilliseconds +
       interest_->getInterestLifetimeMilliseconds();
   else
     // No timeout.
     timeoutTimeMilliseconds_ = -1.0;
-}
\ No newline at end of file
+}
+bool
+SyncBasedDiscovery::PendingInterestTable::add
+  (const ptr_lib::shared_ptr<PendingInterest>& pendingInterest,
+   MillisecondsSince1970 nowMilliseconds)
+{
+  removeExpired(nowMilliseconds);
+  
+  const Interest& interest = *pendingInterest->getInterest();
+  if (interest.getName().size() < keyLength_) {
+    return false;
+  }
+  std::string duplicateKey = getDuplicateKey(interest);
+  if (duplicateKey.size() > 0 && !duplicateKeys_.insert(duplicateKey).second) {
+    return false;
+  }
+  
+  std::string key = getKey(interest.getName());
+  Bucket& bucket = buckets_[key];
+  std::string aggregateKey = getAggregateKey(*pendingInterest);
+  std::unordered_map<std::string, uint64_t>::iterator aggregate = aggregateKeys_.find(aggregateKey);
+  
+  uint64_t id;
+  if (aggregate != aggregateKeys_.end()) {
+    id = aggregate->second;
+    Entry& entry = bucket.find(id)->second;
+    ++aggregatedCount_;
+    
+    // Interests without timeout keep the entry forever
+    MillisecondsSince1970 timeout = entry.pendingInterest_->getTimeoutTimeMilliseconds();
+    if (timeout < 0.0 || 
+        (pendingInterest->getTimeoutTimeMilliseconds() >= 0.0 && 
+         pendingInterest->getTimeoutTimeMilliseconds() <= timeout)) {
+      if (duplicateKey.size() > 0) {
+        entry.duplicateKeys_.push_back(duplicateKey);
+      }
+      return true;
+    }
+    entry.pendingInterest_ = pendingInterest;
+    if (duplicateKey.size() > 0) {
+      entry.duplicateKeys_.push_back(duplicateKey);
+    }
+  }
+  else {
+    id = nextId_++;
+    Entry& entry = bucket.insert(Bucket::value_type(id, Entry(pendingInterest, aggregateKey))).first->second;
+    if (duplicateKey.size() > 0) {
+      entry.duplicateKeys_.push_back(duplicateKey);
+    }
+    aggregateKeys_[aggregateKey] = id;
+    ++size_;
+  }
+  
+  if (pendingInterest->getTimeoutTimeMilliseconds() >= 0.0) {
+    expiries_.push(Expiry(pendingInterest->getTimeoutTimeMilliseconds(), id, key));
+  }
+  return true;
+}
+
+void
+SyncBasedDiscovery::PendingInterestTable::extractMatching
+  (const Name& dataName, MillisecondsSince1970 nowMilliseconds,
+   std::vector<ptr_lib::shared_ptr<PendingInterest> >& matched)
+{
+  removeExpired(nowMilliseconds);
+  if (dataName.size() < keyLength_) {
+    return;
+  }
+  
+  std::unordered_map<std::string, Bucket>::iterator bucket = buckets_.find(getKey(dataName));
+  if (bucket == buckets_.end()) {
+    return;
+  }
+  for (Bucket::iterator item = bucket->second.begin(); item != bucket->second.end(); ) {
+    if (item->second.pendingInterest_->getInterest()->matchesName(dataName)) {
+      matched.push_back(item->second.pendingInterest_);
+      erase(bucket->second, item++);
+    }
+    else {
+      ++item;
+    }
+  }
+  if (bucket->second.size() == 0) {
+    buckets_.erase(bucket);
+  }
+}
+
+void
+SyncBasedDiscovery::PendingInterestTable::extract
+  (const Name& prefix, MillisecondsSince1970 nowMilliseconds,
+   std::vector<ptr_lib::shared_ptr<PendingInterest> >& matched)
+{
+  removeExpired(nowMilliseconds);
+  
+  std::unordered_map<std::string, Bucket>::iterator bucket = buckets_.find(getKey(prefix));
+  if (bucket == buckets_.end()) {
+    return;
+  }
+  for (Bucket::iterator item = bucket->second.begin(); item != bucket->second.end(); ) {
+    matched.push_back(item->second.pendingInterest_);
+    erase(bucket->second, item++);
+  }
+  buckets_.erase(bucket);
+}
+
+void
+SyncBasedDiscovery::PendingInterestTable::removeExpired
+  (MillisecondsSince1970 nowMilliseconds)
+{
+  while (expiries_.size() > 0 && nowMilliseconds >= expiries_.top().time_) {
+    const Expiry& expiry = expiries_.top();
+    // The entry is gone if it was extracted before timing out, and it's kept if
+    // a later interest was aggregated into it
+    std::unordered_map<std::string, Bucket>::iterator bucket = buckets_.find(expiry.key_);
+    if (bucket != buckets_.end()) {
+      Bucket::iterator item = bucket->second.find(expiry.id_);
+      if (item != bucket->second.end() && 
+          item->second.pendingInterest_->isTimedOut(nowMilliseconds)) {
+        erase(bucket->second, item);
+        if (bucket->second.size() == 0) {
+          buckets_.erase(bucket);
+        }
+      }
+    }
+    expiries_.pop();
+  }
+}
+
+std::string
+SyncBasedDiscovery::PendingInterestTable::getKey(const Name& name)
+{
+  return name.getPrefix(keyLength_).toUri();
+}
+
+std::string
+SyncBasedDiscovery::PendingInterestTable::getDuplicateKey(const Interest& interest)
+{
+  if (interest.getNonce().size() == 0) {
+    return "";
+  }
+  return interest.getName().toUri() + " " + interest.getNonce().toHex();
+}
+
+std::string
+SyncBasedDiscovery::PendingInterestTable::getAggregateKey(PendingInterest& pendingInterest)
+{
+  ostringstream key;
+  key << pendingInterest.getInterest()->getName().toUri() << " " << &pendingInterest.getFace();
+  return key.str();
+}
+
+void
+SyncBasedDiscovery::PendingInterestTable::erase(Bucket& bucket, Bucket::iterator item)
+{
+  for (size_t i = 0; i < item->second.duplicateKeys_.size(); ++i) {
+    duplicateKeys_.erase(item->second.duplicateKeys_[i]);
+  }
+  aggregateKeys_.erase(item->second.aggregateKey_);
+  bucket.erase(item);
+  --size_;
+}
@@ -0,0 +1,158 @@
+#include "sync-data-codec.h"
+
+using namespace std;
+using namespace ndn;
+using namespace entity_discovery;
+
+size_t
+SyncDataCodec::encode
+  (SyncDataFormat format, const vector<Entry>& entries, size_t begin,
+   size_t maxSize, string& output)
+{
+  output.clear();
+  size_t i = begin;
+
+  if (format == SyncDataFormat::TEXT) {
+    for (; i < entries.size(); ++i) {
+      size_t entrySize = entries[i].name_.size() + (entries[i].type_ == OBJECT ? 1 : 2);
+      if (i > begin && output.size() + entrySize > maxSize) {
+        break;
+      }
+      if (entries[i].type_ == ADDED) {
+        output += "+";
+      }
+      else if (entries[i].type_ == REMOVED) {
+        output += "-";
+      }
+      output += entries[i].name_;
+      output += "\n";
+    }
+    return i;
+  }
+
+  output += (char)BINARY_MAGIC;
+  output += (char)BINARY_VERSION;
+
+  // Each entry is type, length of prefix shared with the previous name,
+  // length of the rest of the name, and the rest of the name.
+  string entry;
+  const string *previous = 0;
+  for (; i < entries.size(); ++i) {
+    const string& name = entries[i].name_;
+    size_t shared = 0;
+    if (previous) {
+      size_t limit = min(previous->size(), name.size());
+      while (shared < limit && (*previous)[shared] == name[shared]) {
+        ++shared;
+      }
+    }
+
+    entry.clear();
+    entry += (char)entries[i].type_;
+    encodeVarNumber(shared, entry);
+    encodeVarNumber(name.size() - shared, entry);
+    entry.append(name, shared, string::npos);
+
+    if (i > begin && output.size() + entry.size() > maxSize) {
+      break;
+    }
+    output += entry;
+    previous = &name;
+  }
+  return i;
+}
+
+bool
+SyncDataCodec::decode(const uint8_t *buf, size_t size, const OnEntry& onEntry)
+{
+  const uint8_t *end = buf + size;
+
+  if (size == 0 || buf[0] != BINARY_MAGIC) {
+    // TEXT, which never starts with BINARY_MAGIC since names start with '/'
+    while (buf < end) {
+      const uint8_t *lineEnd = buf;
+      while (lineEnd < end && *lineEnd != '\n') {
+        ++lineEnd;
+      }
+      if (lineEnd > buf) {
+        EntryType type = OBJECT;
+        const uint8_t *name = buf;
+        if (*buf == '+') {
+          type = ADDED;
+          ++name;
+        }
+        else if (*buf == '-') {
+          type = REMOVED;
+          ++name;
+        }
+        onEntry(type, (const char *)name, lineEnd - name);
+      }
+      buf = lineEnd + 1;
+    }
+    return true;
+  }
+
+  if (size < 2 || buf[1] != BINARY_VERSION) {
+    return false;
+  }
+  buf += 2;
+
+  // A name that shares no prefix with the previous one is passed pointing into buf;
+  // the others are rebuilt in name, from the prefix shared with the previous one
+  string name;
+  const char *previous = 0;
+  size_t previousLength = 0;
+  while (buf < end) {
+    uint8_t type = *buf++;
+    uint64_t shared;
+    uint64_t suffixLength;
+    if (type > REMOVED ||
+        !decodeVarNumber(buf, end, shared) || !decodeVarNumber(buf, end, suffixLength) ||
+        shared > previousLength || suffixLength > (uint64_t)(end - buf)) {
+      return false;
+    }
+
+    if (shared == 0) {
+      previous = (const char *)buf;
+      previousLength = suffixLength;
+    }
+    else {
+      if (previous != name.data()) {
+        name.assign(previous, shared);
+      }
+      else {
+        name.resize(shared);
+      }
+      name.append((const char *)buf, suffixLength);
+      previous = name.data();
+      previousLength = name.size();
+    }
+    onEntry((EntryType)type, previous, previousLength);
+    buf += suffixLength;
+  }
+  return true;
+}
+
+void
+SyncDataCodec::encodeVarNumber(uint64_t value, string& output)
+{
+  while (value >= 0x80) {
+    output += (char)((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  output += (char)value;
+}
+
+bool
+SyncDataCodec::decodeVarNumber(const uint8_t *& buf, const uint8_t *end, uint64_t& value)
+{
+  value = 0;
+  for (int shift = 0; buf < end && shift < 64; shift += 7) {
+    uint8_t byte = *buf++;
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,174 @@
+#include "sync-iblt.h"
+#include "sync-data-codec.h"
+#include <openssl/sha.h>
+
+using namespace std;
+using namespace ndn;
+using namespace entity_discovery;
+
+/**
+ * Mix the bits of value (the splitmix64 finalizer), for deriving cell indexes
+ * and check hashes from keys that are already uniformly distributed.
+ */
+static uint64_t
+mix(uint64_t value)
+{
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+  return value ^ (value >> 31);
+}
+
+SyncIblt::SyncIblt(size_t cellCount)
+: cells_((cellCount + HASH_COUNT - 1) / HASH_COUNT * HASH_COUNT)
+{
+}
+
+uint64_t
+SyncIblt::getKey(const string& name)
+{
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  SHA256((const uint8_t *)name.data(), name.size(), digest);
+
+  uint64_t key = 0;
+  for (size_t i = 0; i < sizeof(key); ++i) {
+    key = (key << 8) | digest[i];
+  }
+  return key;
+}
+
+void
+SyncIblt::update(uint64_t key, int64_t count)
+{
+  if (cells_.size() == 0) {
+    return;
+  }
+  uint32_t hash = checkHash(key);
+  for (size_t i = 0; i < HASH_COUNT; ++i) {
+    Cell& cell = cells_[getCellIndex(key, i)];
+    cell.count_ += count;
+    cell.keySum_ ^= key;
+    cell.hashSum_ ^= hash;
+  }
+}
+
+size_t
+SyncIblt::getCellIndex(uint64_t key, size_t i) const
+{
+  size_t partitionSize = cells_.size() / HASH_COUNT;
+  return i * partitionSize + mix(key + i) % partitionSize;
+}
+
+uint32_t
+SyncIblt::checkHash(uint64_t key)
+{
+  return (uint32_t)mix(key ^ 0x5bd1e9955bd1e995ULL);
+}
+
+void
+SyncIblt::subtract(const SyncIblt& other)
+{
+  for (size_t i = 0; i < cells_.size() && i < other.cells_.size(); ++i) {
+    cells_[i].count_ -= other.cells_[i].count_;
+    cells_[i].keySum_ ^= other.cells_[i].keySum_;
+    cells_[i].hashSum_ ^= other.cells_[i].hashSum_;
+  }
+}
+
+bool
+SyncIblt::listEntries(vector<uint64_t>& positive, vector<uint64_t>& negative) const
+{
+  SyncIblt table(*this);
+
+  // Removing a listed key from its other cells may make them pure, so keep
+  // going until a pass finds no pure cell. A table lists at most as many keys as it
+  // has cells, more means check hashes collided.
+  bool peeled = true;
+  while (peeled && positive.size() + negative.size() <= table.cells_.size()) {
+    peeled = false;
+    for (size_t i = 0; i < table.cells_.size(); ++i) {
+      const Cell& cell = table.cells_[i];
+      if (!cell.isPure()) {
+        continue;
+      }
+      uint64_t key = cell.keySum_;
+      if (cell.count_ == 1) {
+        positive.push_back(key);
+        table.update(key, -1);
+      }
+      else {
+        negative.push_back(key);
+        table.update(key, 1);
+      }
+      peeled = true;
+    }
+  }
+
+  for (size_t i = 0; i < table.cells_.size(); ++i) {
+    if (!table.cells_[i].isEmpty()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Blob
+SyncIblt::encode() const
+{
+  string output;
+  output += (char)MAGIC;
+  output += (char)VERSION;
+  SyncDataCodec::encodeVarNumber(cells_.size(), output);
+
+  // Each cell is its zigzag encoded count, followed by the key sum and hash sum
+  // in big endian; counts are mostly small, sums are random.
+  for (size_t i = 0; i < cells_.size(); ++i) {
+    const Cell& cell = cells_[i];
+    SyncDataCodec::encodeVarNumber
+      (((uint64_t)cell.count_ << 1) ^ (uint64_t)(cell.count_ >> 63), output);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      output += (char)(cell.keySum_ >> shift);
+    }
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      output += (char)(cell.hashSum_ >> shift);
+    }
+  }
+  return Blob((const uint8_t *)output.data(), output.size());
+}
+
+bool
+SyncIblt::decode(const uint8_t *buf, size_t size, SyncIblt& result)
+{
+  const uint8_t *end = buf + size;
+  if (size < 2 || buf[0] != MAGIC || buf[1] != VERSION) {
+    return false;
+  }
+  buf += 2;
+
+  uint64_t cellCount;
+  // Every cell takes at least 13 bytes, which also bounds the allocation below
+  if (!SyncDataCodec::decodeVarNumber(buf, end, cellCount) || cellCount == 0 || 
+      cellCount % HASH_COUNT != 0 || cellCount > (uint64_t)(end - buf) / 13) {
+    return false;
+  }
+
+  vector<Cell> cells(cellCount);
+  for (size_t i = 0; i < cells.size(); ++i) {
+    uint64_t count;
+    if (!SyncDataCodec::decodeVarNumber(buf, end, count) || end - buf < 12) {
+      return false;
+    }
+    cells[i].count_ = (int64_t)(count >> 1) ^ -(int64_t)(count & 1);
+    for (size_t j = 0; j < 8; ++j) {
+      cells[i].keySum_ = (cells[i].keySum_ << 8) | *buf++;
+    }
+    for (size_t j = 0; j < 4; ++j) {
+      cells[i].hashSum_ = (cells[i].hashSum_ << 8) | *buf++;
+    }
+  }
+  if (buf != end) {
+    return false;
+  }
+
+  result.cells_.swap(cells);
+  return true;
+}
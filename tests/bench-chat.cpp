@@ -0,0 +1,275 @@
+// Runs K chat participants in one room on a SimulatedNetwork, each sending messages at
+// a steady rate, and reports the delivered messages per second, the delivery latency
+// from sendMessage to the observer of every other participant, in virtual time, the
+// interests and data per delivered message, and the CPU time it takes, with the part of
+// it spent signing chat and sync data.
+//
+// Usage: bench-chat [participants,...] [messages per participant] [messages per second
+//   per participant] [message bytes] [latency ms] [loss] [limit seconds]
+// Each message carries its send time, which is how receivers measure the latency. The
+// signing cost is the time of one KeyChain::sign of a chat-sized Data, measured apart,
+// times the Data the faces sent.
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <time.h>
+
+#include "chrono-chat.h"
+#include "simulated-network.h"
+
+using namespace std;
+using namespace ndn;
+using namespace ndn::func_lib;
+using namespace chrono_chat;
+using namespace ndnrtc_addon;
+using namespace test;
+
+class Simulation
+{
+public:
+  Simulation
+    (size_t participantCount, size_t messageCount, double rate, size_t messageSize,
+     Milliseconds latency, double loss, KeyChain& keyChain, const Name& certificateName)
+  : network_(latency, latency / 2, loss), messageCount_(messageCount), rate_(rate),
+    messageSize_(messageSize), sentCount_(0), deliveredCount_(0)
+  {
+    for (size_t i = 0; i < participantCount; ++i) {
+      ptr_lib::shared_ptr<Participant> participant(new Participant(*this, network_, i));
+      participant->chat_ = ptr_lib::make_shared<Chat>
+        (Name("/ndn/broadcast/bench-chat"), participant->screenName_, "benchroom",
+         Name("/bench").append(participant->screenName_), participant.get(),
+         participant->face_, network_.getScheduler(), keyChain, certificateName);
+      participant->chat_->start();
+      participants_.push_back(participant);
+    }
+    // Let every participant join the room before anything is sent
+    network_.run(2000);
+  }
+
+  ~Simulation()
+  {
+    for (size_t i = 0; i < participants_.size(); ++i) {
+      participants_[i]->chat_->shutdown();
+    }
+  }
+
+  /**
+   * Schedule the messages of every participant, staggered over the interval between
+   * two messages, and run until every message reached every other participant, or for
+   * limit milliseconds.
+   */
+  void
+  run(Milliseconds limit)
+  {
+    network_.resetCounters();
+    for (size_t i = 0; i < participants_.size(); ++i) {
+      participants_[i]->face_.resetCounters();
+    }
+    double startCpu = getProcessCpuMilliseconds();
+    MillisecondsSince1970 startTime = network_.getNowMilliseconds();
+
+    Milliseconds interval = 1000.0 / rate_;
+    for (size_t i = 0; i < participants_.size(); ++i) {
+      Milliseconds offset = interval * i / participants_.size();
+      for (size_t j = 0; j < messageCount_; ++j) {
+        network_.getScheduler().schedule
+          (offset + interval * j, bind(&Simulation::send, this, i));
+      }
+    }
+
+    size_t expectedCount = participants_.size() * (participants_.size() - 1) * messageCount_;
+    while (deliveredCount_ < expectedCount &&
+           network_.getNowMilliseconds() - startTime < limit) {
+      network_.run(10);
+    }
+
+    duration_ = network_.getNowMilliseconds() - startTime;
+    cpuMilliseconds_ = getProcessCpuMilliseconds() - startCpu;
+  }
+
+  void
+  report(Milliseconds signMilliseconds)
+  {
+    size_t participantCount = participants_.size();
+    size_t expectedCount = participantCount * (participantCount - 1) * messageCount_;
+    PacketCounters sent;
+    for (size_t i = 0; i < participantCount; ++i) {
+      const PacketCounters& counters = participants_[i]->face_.getCounters();
+      sent.interests_ += counters.interests_;
+      sent.data_ += counters.data_;
+    }
+    sort(latencies_.begin(), latencies_.end());
+    double delivered = max((size_t)1, deliveredCount_);
+
+    cout << left << setw(7) << participantCount << right << setw(8) << sentCount_
+         << fixed << setprecision(1)
+         << setw(8) << 100.0 * deliveredCount_ / max((size_t)1, expectedCount)
+         << setw(10) << deliveredCount_ * 1000.0 / duration_;
+    cout << setprecision(0);
+    if (latencies_.empty()) {
+      cout << setw(8) << "-" << setw(8) << "-" << setw(8) << "-";
+    }
+    else {
+      cout << setw(8) << getPercentile(0.5) << setw(8) << getPercentile(0.95)
+           << setw(8) << getPercentile(0.99);
+    }
+    cout << setprecision(2)
+         << setw(10) << sent.interests_ / delivered
+         << setw(10) << sent.data_ / delivered
+         << setprecision(1)
+         << setw(10) << cpuMilliseconds_ * 1000 / delivered
+         << setw(10) << 100.0 * sent.data_ * signMilliseconds / cpuMilliseconds_ << endl;
+  }
+
+private:
+  /**
+   * A participant with its face, which measures the latency of the messages it receives.
+   */
+  class Participant : public ChatObserver
+  {
+  public:
+    Participant(Simulation& simulation, SimulatedNetwork& network, size_t index)
+    : simulation_(simulation), face_(network)
+    {
+      ostringstream screenName;
+      screenName << "participant" << index;
+      screenName_ = screenName.str();
+    }
+
+    void
+    onStateChanged
+      (MessageTypes type, const char *prefix, const char *userName, const char *msg,
+       double timestamp)
+    {
+      // Chat also reports the messages sent here
+      if (type != MessageTypes::CHAT || screenName_ == userName) {
+        return;
+      }
+      ++simulation_.deliveredCount_;
+      simulation_.latencies_.push_back
+        (simulation_.network_.getNowMilliseconds() - ::atof(msg));
+    }
+
+    Simulation& simulation_;
+    string screenName_;
+    SimulatedFace face_;
+    ptr_lib::shared_ptr<Chat> chat_;
+  };
+
+  void
+  send(size_t participant)
+  {
+    ostringstream message;
+    message << fixed << setprecision(0) << network_.getNowMilliseconds() << " ";
+    string text = message.str();
+    if (text.size() < messageSize_) {
+      text.append(messageSize_ - text.size(), '.');
+    }
+    participants_[participant]->chat_->sendMessage(text);
+    ++sentCount_;
+  }
+
+  Milliseconds
+  getPercentile(double fraction)
+  {
+    return latencies_[min(latencies_.size() - 1, (size_t)(fraction * latencies_.size()))];
+  }
+
+  static double
+  getProcessCpuMilliseconds()
+  {
+    struct timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+  }
+
+  SimulatedNetwork network_;
+  size_t messageCount_;
+  double rate_;
+  size_t messageSize_;
+  vector<ptr_lib::shared_ptr<Participant> > participants_;
+
+  size_t sentCount_;
+  size_t deliveredCount_;
+  // The delivery latency of each message at each receiver
+  vector<Milliseconds> latencies_;
+  Milliseconds duration_;
+  double cpuMilliseconds_;
+};
+
+/**
+ * Return the CPU milliseconds of one signature of a Data with a chat message of
+ * messageSize bytes.
+ */
+static Milliseconds
+measureSigning(KeyChain& keyChain, const Name& certificateName, size_t messageSize)
+{
+  const size_t signCount = 200;
+  Data data(Name("/bench/benchroom/participant0/0/1"));
+  string content(messageSize, '.');
+  data.setContent(Blob((const uint8_t *)content.data(), content.size()));
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+  for (size_t i = 0; i < signCount; ++i) {
+    keyChain.sign(data, certificateName);
+  }
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+  return ((end.tv_sec - start.tv_sec) * 1000.0 +
+          (end.tv_nsec - start.tv_nsec) / 1000000.0) / signCount;
+}
+
+static vector<size_t>
+parseList(const char *list)
+{
+  vector<size_t> values;
+  istringstream stream(list);
+  string value;
+  while (getline(stream, value, ',')) {
+    values.push_back(atoi(value.c_str()));
+  }
+  return values;
+}
+
+int
+main(int argc, char** argv)
+{
+  vector<size_t> participantCounts = parseList(argc > 1 ? argv[1] : "2,10,30");
+  size_t messageCount = argc > 2 ? atoi(argv[2]) : 20;
+  double rate = argc > 3 ? atof(argv[3]) : 1;
+  size_t messageSize = argc > 4 ? atoi(argv[4]) : 100;
+  Milliseconds latency = argc > 5 ? atof(argv[5]) : 5;
+  double loss = argc > 6 ? atof(argv[6]) : 0;
+  Milliseconds limit = (argc > 7 ? atof(argv[7]) : 60) * 1000;
+
+  // Using default keyChain in ndn-cpp
+  KeyChain keyChain;
+  Name certificateName = keyChain.getDefaultCertificateName();
+  Milliseconds signMilliseconds = measureSigning(keyChain, certificateName, messageSize);
+
+  cout << messageCount << " messages of " << messageSize << " bytes per participant, "
+       << rate << " per second; link latency " << latency << " ms, jitter "
+       << latency / 2 << " ms, loss " << loss << ", limit " << limit / 1000 << " s" << endl;
+  cout << "One signature takes " << fixed << setprecision(3) << signMilliseconds
+       << " ms of CPU." << endl;
+  cout << "Delivered is the percentage of messages that reached every other participant, "
+       << "msg/s the deliveries per virtual second; latencies are in virtual milliseconds; "
+       << "interests, data and CPU microseconds are per delivery, sign% the share of the "
+       << "CPU time spent signing." << endl;
+  cout << left << setw(7) << "peers" << right << setw(8) << "sent" << setw(8) << "deliv%"
+       << setw(10) << "msg/s" << setw(8) << "p50 ms" << setw(8) << "p95 ms"
+       << setw(8) << "p99 ms" << setw(10) << "interest" << setw(10) << "data"
+       << setw(10) << "cpu us" << setw(10) << "sign%" << endl;
+
+  for (size_t i = 0; i < participantCounts.size(); ++i) {
+    Simulation simulation
+      (participantCounts[i], messageCount, rate, messageSize, latency, loss, keyChain,
+       certificateName);
+    simulation.run(limit);
+    simulation.report(signMilliseconds);
+  }
+  return 0;
+}
@@ -0,0 +1,306 @@
+// Runs peers that each publish entities on a SimulatedNetwork, and reports how long it
+// takes every peer to discover the entities of every other, in virtual time, with the
+// packets, digest recomputations and CPU time it takes per peer. Each configuration is
+// run with the sync defaults older peers understand; with the incremental digest, digest
+// log and binary replies; and with an IBLT in sync interests on top of those.
+//
+// Usage: bench-discovery [peers,...] [entities per peer,...] [latency ms] [loss] [limit seconds]
+//   [max heartbeat interval seconds]
+// Heartbeats are every 2 s by default; a larger maximum backs them off towards it, which
+// keeps runs with hundreds of peers short. EntityDiscovery reports timeouts on stderr,
+// which is best redirected.
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <time.h>
+
+#include "entity-discovery.h"
+#include "heartbeat-policy.h"
+#include "simulated-network.h"
+
+using namespace std;
+using namespace ndn;
+using namespace entity_discovery;
+using namespace ndnrtc_addon;
+using namespace test;
+
+/**
+ * Entity info that's just its name, as a conference description would be.
+ */
+class NamedEntity : public EntityInfoBase
+{
+public:
+  NamedEntity(const string& name)
+  : name_(name)
+  {}
+
+  string name_;
+};
+
+class NamedEntitySerializer : public IEntitySerializer
+{
+public:
+  virtual Blob
+  serialize(const ptr_lib::shared_ptr<EntityInfoBase> &entityInfo)
+  {
+    const string& name = ptr_lib::dynamic_pointer_cast<NamedEntity>(entityInfo)->name_;
+    return Blob((const uint8_t *)name.data(), name.size());
+  }
+
+  virtual ptr_lib::shared_ptr<EntityInfoBase>
+  deserialize(Blob srcBlob)
+  {
+    return ptr_lib::make_shared<NamedEntity>
+      (string((const char *)srcBlob.buf(), srcBlob.size()));
+  }
+};
+
+/**
+ * The sync options of every EntityDiscovery in a run.
+ */
+class Profile
+{
+public:
+  const char *label_;
+  SyncDigestType digestType_;
+  size_t digestLogLength_;
+  SyncDataFormat dataFormat_;
+  size_t ibltCellCount_;
+};
+
+class Simulation
+{
+public:
+  Simulation
+    (const Profile& profile, size_t peerCount, size_t entityCount, Milliseconds latency,
+     double loss, const HeartbeatPolicy& heartbeatPolicy, KeyChain& keyChain,
+     const Name& certificateName)
+  : network_(latency, latency / 2, loss), entityCount_(entityCount),
+    completePeerCount_(0)
+  {
+    ptr_lib::shared_ptr<NamedEntitySerializer> serializer(new NamedEntitySerializer());
+    for (size_t i = 0; i < peerCount; ++i) {
+      ptr_lib::shared_ptr<Peer> peer(new Peer(*this, network_));
+      peer->discovery_.reset(new EntityDiscovery
+        ("/ndn/broadcast/bench-discovery", peer.get(), serializer, peer->face_,
+         network_.getScheduler(), keyChain, certificateName, profile.digestType_,
+         profile.digestLogLength_, profile.dataFormat_, profile.ibltCellCount_, 256, 0,
+         heartbeatPolicy));
+      peer->discovery_->start();
+      peers_.push_back(peer);
+    }
+    // Let the prefix registrations and first sync interests settle
+    network_.run(1000);
+  }
+
+  ~Simulation()
+  {
+    for (size_t i = 0; i < peers_.size(); ++i) {
+      peers_[i]->discovery_->shutdown();
+    }
+  }
+
+  /**
+   * Publish the entities of every peer at once, and run until every peer discovered
+   * all of them, or for limit milliseconds.
+   */
+  void
+  run(Milliseconds limit)
+  {
+    network_.resetCounters();
+    vector<uint64_t> recomputeCounts;
+    for (size_t i = 0; i < peers_.size(); ++i) {
+      recomputeCounts.push_back(getRecomputeCount(i));
+    }
+    double startCpu = getProcessCpuMilliseconds();
+    startTime_ = network_.getNowMilliseconds();
+
+    for (size_t i = 0; i < peers_.size(); ++i) {
+      ostringstream prefix;
+      prefix << "/bench/peer" << i;
+      vector<string> names;
+      vector<ptr_lib::shared_ptr<EntityInfoBase> > infos;
+      for (size_t j = 0; j < entityCount_; ++j) {
+        ostringstream name;
+        name << "entity" << j;
+        names.push_back(name.str());
+        infos.push_back(ptr_lib::make_shared<NamedEntity>(name.str()));
+      }
+      peers_[i]->discovery_->publishEntities(names, Name(prefix.str()), infos);
+    }
+
+    while (completePeerCount_ < peers_.size() &&
+           network_.getNowMilliseconds() - startTime_ < limit) {
+      network_.run(10);
+    }
+
+    cpuMilliseconds_ = getProcessCpuMilliseconds() - startCpu;
+    recomputeCount_ = 0;
+    for (size_t i = 0; i < peers_.size(); ++i) {
+      recomputeCount_ += getRecomputeCount(i) - recomputeCounts[i];
+    }
+  }
+
+  void
+  report(const string& label)
+  {
+    size_t peerCount = peers_.size();
+    PacketCounters sent;
+    double maxPeerCpu = 0;
+    for (size_t i = 0; i < peerCount; ++i) {
+      const PacketCounters& counters = peers_[i]->face_.getCounters();
+      sent.interests_ += counters.interests_;
+      sent.data_ += counters.data_;
+      sent.bytes_ += counters.bytes_;
+      maxPeerCpu = max(maxPeerCpu, peers_[i]->face_.getCpuMilliseconds());
+    }
+    sort(completeTimes_.begin(), completeTimes_.end());
+
+    cout << left << setw(12) << label << right << setw(7) << peerCount
+         << setw(7) << entityCount_;
+    cout << fixed << setprecision(0);
+    if (completePeerCount_ < peerCount) {
+      cout << setw(10) << "-" << setw(10) << "-";
+    }
+    else {
+      cout << setw(10) << completeTimes_[completeTimes_.size() / 2]
+           << setw(10) << completeTimes_.back();
+    }
+    cout << setprecision(1)
+         << setw(10) << (double)sent.interests_ / peerCount
+         << setw(10) << (double)sent.data_ / peerCount
+         << setw(10) << sent.bytes_ / 1024.0 / peerCount
+         << setw(10) << (double)recomputeCount_ / peerCount
+         << setw(10) << cpuMilliseconds_ / peerCount
+         << setw(10) << maxPeerCpu << endl;
+  }
+
+private:
+  /**
+   * A peer with its face, which counts the entities it discovered.
+   */
+  class Peer : public IDiscoveryObserver
+  {
+  public:
+    Peer(Simulation& simulation, SimulatedNetwork& network)
+    : simulation_(simulation), face_(network), discoveredCount_(0)
+    {}
+
+    void
+    onStateChanged(MessageTypes type, const char *msg, double timestamp)
+    {
+      size_t target = (simulation_.peers_.size() - 1) * simulation_.entityCount_;
+      bool wasComplete = discoveredCount_ == target;
+      if (type == MessageTypes::ADD) {
+        ++discoveredCount_;
+      }
+      else if (type == MessageTypes::REMOVE) {
+        --discoveredCount_;
+      }
+      else {
+        return;
+      }
+
+      if (!wasComplete && discoveredCount_ == target) {
+        ++simulation_.completePeerCount_;
+        simulation_.completeTimes_.push_back
+          (simulation_.network_.getNowMilliseconds() - simulation_.startTime_);
+      }
+      else if (wasComplete && discoveredCount_ != target) {
+        --simulation_.completePeerCount_;
+      }
+    }
+
+    Simulation& simulation_;
+    SimulatedFace face_;
+    ptr_lib::shared_ptr<EntityDiscovery> discovery_;
+    size_t discoveredCount_;
+  };
+
+  uint64_t
+  getRecomputeCount(size_t peer)
+  {
+    return peers_[peer]->discovery_->getSyncBasedDiscovery()->getDigestRecomputeCount();
+  }
+
+  static double
+  getProcessCpuMilliseconds()
+  {
+    struct timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+  }
+
+  SimulatedNetwork network_;
+  size_t entityCount_;
+  vector<ptr_lib::shared_ptr<Peer> > peers_;
+
+  MillisecondsSince1970 startTime_;
+  size_t completePeerCount_;
+  // The time each peer first had every entity, from the start of run
+  vector<Milliseconds> completeTimes_;
+  double cpuMilliseconds_;
+  uint64_t recomputeCount_;
+};
+
+static vector<size_t>
+parseList(const char *list)
+{
+  vector<size_t> values;
+  istringstream stream(list);
+  string value;
+  while (getline(stream, value, ',')) {
+    values.push_back(atoi(value.c_str()));
+  }
+  return values;
+}
+
+int
+main(int argc, char** argv)
+{
+  vector<size_t> peerCounts = parseList(argc > 1 ? argv[1] : "10,30");
+  vector<size_t> entityCounts = parseList(argc > 2 ? argv[2] : "1,10");
+  Milliseconds latency = argc > 3 ? atof(argv[3]) : 5;
+  double loss = argc > 4 ? atof(argv[4]) : 0;
+  Milliseconds limit = (argc > 5 ? atof(argv[5]) : 120) * 1000;
+  Milliseconds maxHeartbeatInterval = (argc > 6 ? atof(argv[6]) : 2) * 1000;
+  HeartbeatPolicy heartbeatPolicy = maxHeartbeatInterval > 2000 ?
+    HeartbeatPolicy(2000, maxHeartbeatInterval, 2) : HeartbeatPolicy();
+
+  // Using default keyChain in ndn-cpp
+  KeyChain keyChain;
+  Name certificateName = keyChain.getDefaultCertificateName();
+
+  cout << "Link latency " << latency << " ms, jitter " << latency / 2 << " ms, loss "
+       << loss << ", limit " << limit / 1000 << " s, heartbeats every 2 to "
+       << maxHeartbeatInterval / 1000 << " s" << endl;
+  cout << "Times are in virtual milliseconds from publishing until half of the peers and "
+       << "all of them have every entity; packets, KB, digest recomputations and CPU "
+       << "milliseconds are per peer, the last column for the busiest peer." << endl;
+  cout << left << setw(12) << "profile" << right << setw(7) << "peers"
+       << setw(7) << "ents" << setw(10) << "p50 ms" << setw(10) << "all ms"
+       << setw(10) << "interest" << setw(10) << "data" << setw(10) << "KB"
+       << setw(10) << "digests" << setw(10) << "cpu ms" << setw(10) << "max cpu" << endl;
+
+  Profile profiles[] = {
+    { "default", SyncDigestType::SHA256_FULL, 0, SyncDataFormat::TEXT, 0 },
+    { "incremental", SyncDigestType::INCREMENTAL, 16, SyncDataFormat::BINARY, 0 },
+    { "iblt", SyncDigestType::INCREMENTAL, 16, SyncDataFormat::BINARY, 64 }
+  };
+
+  for (size_t i = 0; i < peerCounts.size(); ++i) {
+    for (size_t j = 0; j < entityCounts.size(); ++j) {
+      for (size_t k = 0; k < sizeof(profiles) / sizeof(profiles[0]); ++k) {
+        Simulation simulation
+          (profiles[k], peerCounts[i], entityCounts[j], latency, loss, heartbeatPolicy,
+           keyChain, certificateName);
+        simulation.run(limit);
+        simulation.report(profiles[k].label_);
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,360 @@
+// Runs EntityDiscovery on a SimulatedNetwork with a population of hosts that each host
+// one entity, which changes now and then, until the host goes away without stopping it,
+// and is replaced by a new one. An observer that hosts nothing discovers them all, and
+// for several heartbeat policies the bench reports its heartbeat traffic against how
+// long it takes it to notice that an entity is gone or changed, in virtual time.
+//
+// Usage: bench-heartbeat-policy [entities] [minutes] [mean lifetime minutes]
+//   [mean minutes between changes] [latency ms]
+// Hosts heartbeat each other as well, so runs grow with the square of the entities.
+// EntityDiscovery reports timeouts on stderr, which is best redirected.
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <map>
+#include <random>
+
+#include "entity-discovery.h"
+#include "heartbeat-policy.h"
+#include "metrics.h"
+#include "simulated-network.h"
+
+using namespace std;
+using namespace ndn;
+using namespace ndn::func_lib;
+using namespace entity_discovery;
+using namespace ndnrtc_addon;
+using namespace test;
+
+/**
+ * Entity info that's a description, which a change replaces.
+ */
+class DescribedEntity : public EntityInfoBase
+{
+public:
+  DescribedEntity(const string& description)
+  : description_(description)
+  {}
+
+  string description_;
+};
+
+class DescribedEntitySerializer : public IEntitySerializer
+{
+public:
+  virtual Blob
+  serialize(const ptr_lib::shared_ptr<EntityInfoBase> &entityInfo)
+  {
+    const string& description =
+      ptr_lib::dynamic_pointer_cast<DescribedEntity>(entityInfo)->description_;
+    return Blob((const uint8_t *)description.data(), description.size());
+  }
+
+  virtual ptr_lib::shared_ptr<EntityInfoBase>
+  deserialize(Blob srcBlob)
+  {
+    return ptr_lib::make_shared<DescribedEntity>
+      (string((const char *)srcBlob.buf(), srcBlob.size()));
+  }
+};
+
+class Simulation
+{
+public:
+  Simulation
+    (const HeartbeatPolicy& policy, size_t entityCount, double minutes,
+     double meanLifetimeMinutes, double meanChangeMinutes, Milliseconds latency,
+     KeyChain& keyChain, const Name& certificateName)
+  : network_(latency, latency / 2), policy_(policy), keyChain_(keyChain),
+    certificateName_(certificateName), serializer_(new DescribedEntitySerializer()),
+    duration_(minutes * 60000), lifetime_(1 / (meanLifetimeMinutes * 60000)),
+    change_(1 / (meanChangeMinutes * 60000)), random_(1),
+    metrics_(ptr_lib::make_shared<MetricsRegistry>())
+  {
+    observer_.reset(new Peer(*this, network_, -1));
+    observer_->discovery_ = createDiscovery(*observer_, metrics_);
+    observer_->discovery_->start();
+    for (size_t i = 0; i < entityCount; ++i) {
+      addHost();
+    }
+    // Let the observer discover every entity before anything changes or goes
+    network_.run(policy_.getMinInterval() * 3);
+  }
+
+  ~Simulation()
+  {
+    observer_->discovery_->shutdown();
+    for (size_t i = 0; i < hosts_.size(); ++i) {
+      if (hosts_[i]->isAlive_) {
+        hosts_[i]->discovery_->shutdown();
+      }
+    }
+  }
+
+  /**
+   * Give each host its lifetime and changes, and run for the duration.
+   */
+  void
+  run()
+  {
+    MetricsSnapshot start = metrics_->snapshot();
+    startTime_ = network_.getNowMilliseconds();
+    for (size_t i = 0; i < hosts_.size(); ++i) {
+      scheduleHost(i);
+    }
+    network_.run(duration_);
+
+    MetricsSnapshot end = metrics_->snapshot();
+    interestCount_ = end.counters_["discovery.interests_sent"] -
+      start.counters_["discovery.interests_sent"];
+    answerCount_ = end.histograms_["discovery.heartbeat_rtt_us"].count_ -
+      start.histograms_["discovery.heartbeat_rtt_us"].count_;
+  }
+
+  void
+  report(const string& label, size_t entityCount)
+  {
+    double entityMinutes = entityCount * duration_ / 60000;
+    sort(removalDelays_.begin(), removalDelays_.end());
+    sort(changeDelays_.begin(), changeDelays_.end());
+
+    cout << left << setw(28) << label << right << fixed << setprecision(2)
+         << setw(10) << interestCount_ / entityMinutes
+         << setw(10) << (interestCount_ - min(interestCount_, answerCount_)) / entityMinutes
+         << setprecision(0)
+         << setw(9) << removalDelays_.size()
+         << setw(10) << getMean(removalDelays_)
+         << setw(10) << getPercentile(removalDelays_, 0.95)
+         << setw(9) << changeDelays_.size()
+         << setw(10) << getMean(changeDelays_)
+         << setw(10) << getPercentile(changeDelays_, 0.95) << endl;
+  }
+
+private:
+  /**
+   * A peer with its face: the observer, or a host of the entity index.
+   */
+  class Peer : public IDiscoveryObserver
+  {
+  public:
+    Peer(Simulation& simulation, SimulatedNetwork& network, int index)
+    : simulation_(simulation), face_(network), isAlive_(true), changeCount_(0),
+      unseenChangeTime_(-1)
+    {
+      if (index >= 0) {
+        ostringstream prefix;
+        prefix << "/bench/host" << index;
+        prefix_ = Name(prefix.str());
+      }
+    }
+
+    void
+    onStateChanged(MessageTypes type, const char *msg, double timestamp)
+    {
+      if (this == simulation_.observer_.get()) {
+        simulation_.onObserverStateChanged(type, msg);
+      }
+    }
+
+    /**
+     * Publish the entity with the description of its current change.
+     */
+    void
+    publish()
+    {
+      ostringstream description;
+      description << "entity, change " << changeCount_;
+      discovery_->publishEntity
+        ("entity", prefix_, ptr_lib::make_shared<DescribedEntity>(description.str()));
+    }
+
+    Simulation& simulation_;
+    SimulatedFace face_;
+    ptr_lib::shared_ptr<EntityDiscovery> discovery_;
+    Name prefix_;
+    bool isAlive_;
+    MillisecondsSince1970 deathTime_;
+    size_t changeCount_;
+    // The first change the observer hasn't seen, or -1
+    MillisecondsSince1970 unseenChangeTime_;
+  };
+
+  ptr_lib::shared_ptr<EntityDiscovery>
+  createDiscovery(Peer& peer, ptr_lib::shared_ptr<MetricsRegistry> metrics)
+  {
+    return ptr_lib::make_shared<EntityDiscovery>
+      ("/ndn/broadcast/bench-heartbeat-policy", &peer, serializer_, peer.face_,
+       network_.getScheduler(), keyChain_, certificateName_, SyncDigestType::SHA256_FULL,
+       0, SyncDataFormat::TEXT, 0, 256, 0, policy_, metrics);
+  }
+
+  /**
+   * Start a host, which publishes its entity.
+   */
+  size_t
+  addHost()
+  {
+    size_t index = hosts_.size();
+    ptr_lib::shared_ptr<Peer> host(new Peer(*this, network_, index));
+    // Hosts' metrics aren't reported
+    host->discovery_ = createDiscovery(*host, ptr_lib::shared_ptr<MetricsRegistry>());
+    host->discovery_->start();
+    host->publish();
+    hosts_.push_back(host);
+    hostIndexes_[Name(host->prefix_).append("entity").toUri()] = index;
+    return index;
+  }
+
+  void
+  scheduleHost(size_t index)
+  {
+    network_.getScheduler().schedule
+      (lifetime_(random_), bind(&Simulation::onHostGone, this, index));
+    network_.getScheduler().schedule
+      (change_(random_), bind(&Simulation::onHostChange, this, index));
+  }
+
+  /**
+   * The host goes away without stopping its entity, and another takes its place, which
+   * keeps the population steady.
+   */
+  void
+  onHostGone(size_t index)
+  {
+    Peer& host = *hosts_[index];
+    host.isAlive_ = false;
+    host.deathTime_ = network_.getNowMilliseconds();
+    host.discovery_->shutdown();
+    scheduleHost(addHost());
+  }
+
+  void
+  onHostChange(size_t index)
+  {
+    Peer& host = *hosts_[index];
+    if (!host.isAlive_) {
+      return;
+    }
+    ++host.changeCount_;
+    host.publish();
+    if (host.unseenChangeTime_ < 0) {
+      host.unseenChangeTime_ = network_.getNowMilliseconds();
+    }
+    network_.getScheduler().schedule
+      (change_(random_), bind(&Simulation::onHostChange, this, index));
+  }
+
+  void
+  onObserverStateChanged(MessageTypes type, const char *entityName)
+  {
+    map<string, size_t>::iterator index = hostIndexes_.find(entityName);
+    if (index == hostIndexes_.end()) {
+      return;
+    }
+    Peer& host = *hosts_[index->second];
+    MillisecondsSince1970 now = network_.getNowMilliseconds();
+
+    if (type == MessageTypes::ADD) {
+      // Discovery fetches the current info, whatever changed before
+      host.unseenChangeTime_ = -1;
+    }
+    else if (type == MessageTypes::SET && host.unseenChangeTime_ >= 0) {
+      changeDelays_.push_back(now - host.unseenChangeTime_);
+      host.unseenChangeTime_ = -1;
+    }
+    else if (type == MessageTypes::REMOVE && !host.isAlive_ && host.deathTime_ >= startTime_) {
+      removalDelays_.push_back(now - host.deathTime_);
+      hostIndexes_.erase(index);
+    }
+  }
+
+  static double
+  getMean(const vector<double>& values)
+  {
+    double sum = 0;
+    for (size_t i = 0; i < values.size(); ++i) {
+      sum += values[i];
+    }
+    return values.empty() ? 0 : sum / values.size();
+  }
+
+  static double
+  getPercentile(const vector<double>& sortedValues, double fraction)
+  {
+    if (sortedValues.empty()) {
+      return 0;
+    }
+    return sortedValues[(size_t)(fraction * (sortedValues.size() - 1))];
+  }
+
+  SimulatedNetwork network_;
+  HeartbeatPolicy policy_;
+  KeyChain& keyChain_;
+  Name certificateName_;
+  ptr_lib::shared_ptr<IEntitySerializer> serializer_;
+  Milliseconds duration_;
+  exponential_distribution<double> lifetime_;
+  exponential_distribution<double> change_;
+  mt19937 random_;
+
+  ptr_lib::shared_ptr<MetricsRegistry> metrics_;
+  ptr_lib::shared_ptr<Peer> observer_;
+  // Gone hosts stay, since their EntityDiscovery may still have events scheduled
+  vector<ptr_lib::shared_ptr<Peer> > hosts_;
+  // The host of each entity full name, until the observer removes it
+  map<string, size_t> hostIndexes_;
+
+  MillisecondsSince1970 startTime_;
+  uint64_t interestCount_;
+  uint64_t answerCount_;
+  vector<double> removalDelays_;
+  vector<double> changeDelays_;
+};
+
+int
+main(int argc, char** argv)
+{
+  size_t entityCount = argc > 1 ? atoi(argv[1]) : 30;
+  double minutes = argc > 2 ? atof(argv[2]) : 30;
+  double meanLifetimeMinutes = argc > 3 ? atof(argv[3]) : 10;
+  double meanChangeMinutes = argc > 4 ? atof(argv[4]) : 5;
+  Milliseconds latency = argc > 5 ? atof(argv[5]) : 5;
+
+  // Using default keyChain in ndn-cpp
+  KeyChain keyChain;
+  Name certificateName = keyChain.getDefaultCertificateName();
+
+  cout << entityCount << " entities, " << minutes << " minutes, mean lifetime "
+       << meanLifetimeMinutes << " minutes, mean time between changes "
+       << meanChangeMinutes << " minutes, link latency " << latency << " ms" << endl;
+  cout << "Interests and timeouts are the observer's per entity per minute, delays in "
+       << "virtual milliseconds." << endl;
+  cout << left << setw(28) << "policy" << right
+       << setw(10) << "interest" << setw(10) << "timeout"
+       << setw(9) << "removed" << setw(10) << "mean" << setw(10) << "p95"
+       << setw(9) << "changed" << setw(10) << "mean" << setw(10) << "p95" << endl;
+
+  const char *labels[] = {
+    "fixed 2 s (default)", "fixed 5 s", "adaptive 2-10 s x1.25",
+    "adaptive 2-30 s x1.5", "adaptive 2-60 s x2"
+  };
+  HeartbeatPolicy policies[] = {
+    HeartbeatPolicy(),
+    HeartbeatPolicy(5000, 5000),
+    HeartbeatPolicy(2000, 10000, 1.25),
+    HeartbeatPolicy(2000, 30000, 1.5),
+    HeartbeatPolicy(2000, 60000, 2)
+  };
+
+  for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); ++i) {
+    Simulation simulation
+      (policies[i], entityCount, minutes, meanLifetimeMinutes, meanChangeMinutes, latency,
+       keyChain, certificateName);
+    simulation.run();
+    simulation.report(labels[i], entityCount);
+  }
+  return 0;
+}
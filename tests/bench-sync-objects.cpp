@@ -0,0 +1,301 @@
+// Times the SyncBasedDiscovery operations on its object set, and counts the memory
+// allocations they make, on synthetic sets of names from 10 up to the largest size:
+// addObject, removeObject, recomputeDigest, objectsToString, stringToObjects, and onData
+// with a full sync reply, sorted as peers send it (merged with the objects in one pass)
+// or shuffled (sorted and diffed with set_symmetric_difference). Each operation is run
+// with the default sync options, and with the incremental digest, digest log and IBLT,
+// which addObject and removeObject keep up to date. SyncDataCodec alone is timed
+// encoding and decoding a full list of sorted names, as TEXT and as BINARY.
+//
+// Usage: bench-sync-objects [largest set size]
+// No forwarder is needed: the face is never used, and the scheduler never processed.
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <random>
+#include <new>
+#include <chrono>
+
+#include "sync-based-discovery.h"
+
+using namespace std;
+using namespace ndn;
+using namespace ndn::func_lib;
+using namespace entity_discovery;
+using namespace ndnrtc_addon;
+
+#if NDN_CPP_HAVE_STD_FUNCTION && NDN_CPP_WITH_STD_FUNCTION
+using namespace func_lib::placeholders;
+#endif
+
+// Every allocation of the process is counted, the measured ones by difference
+static uint64_t allocationCount = 0;
+
+void *
+operator new(size_t size)
+{
+  ++allocationCount;
+  void *memory = malloc(size > 0 ? size : 1);
+  if (!memory) {
+    throw bad_alloc();
+  }
+  return memory;
+}
+
+void
+operator delete(void *memory) noexcept
+{
+  free(memory);
+}
+
+/**
+ * Measures a run of operations: the time per operation, and the allocations per
+ * operation.
+ */
+class Measurement
+{
+public:
+  Measurement()
+  : startTime_(chrono::steady_clock::now()), startAllocationCount_(allocationCount)
+  {}
+
+  void
+  report(const string& operation, const string& label, size_t size, size_t operationCount)
+  {
+    double nanoseconds = (double)chrono::duration_cast<chrono::nanoseconds>
+      (chrono::steady_clock::now() - startTime_).count();
+    uint64_t allocations = allocationCount - startAllocationCount_;
+
+    cout << left << setw(18) << operation << setw(13) << label << right << setw(8) << size
+         << fixed << setprecision(1)
+         << setw(14) << nanoseconds / operationCount
+         << setw(12) << (double)allocations / operationCount << endl;
+  }
+
+private:
+  chrono::steady_clock::time_point startTime_;
+  uint64_t startAllocationCount_;
+};
+
+/**
+ * The sync options of the SyncBasedDiscovery under measurement.
+ */
+class Profile
+{
+public:
+  const char *label_;
+  SyncDigestType digestType_;
+  size_t digestLogLength_;
+  size_t ibltCellCount_;
+};
+
+class Benchmark
+{
+public:
+  Benchmark(Face& face, Scheduler& scheduler, KeyChain& keyChain, const Name& certificateName)
+  : face_(face), scheduler_(scheduler), keyChain_(keyChain),
+    certificateName_(certificateName), broadcastPrefix_("/ndn/broadcast/bench-sync"),
+    random_(1), differenceCount_(0)
+  {}
+
+  void
+  run(const Profile& profile, size_t size)
+  {
+    vector<string> names = makeNames(size, 0);
+    // Calls that take one operation per set are repeated on small sets
+    size_t repeatCount = max((size_t)1, (size_t)100000 / size);
+
+    ptr_lib::shared_ptr<SyncBasedDiscovery> discovery = makeDiscovery(profile);
+    {
+      Measurement measurement;
+      for (size_t i = 0; i < names.size(); ++i) {
+        discovery->addObject(names[i], false);
+      }
+      measurement.report("addObject", profile.label_, size, names.size());
+    }
+    {
+      Measurement measurement;
+      for (size_t i = 0; i < repeatCount; ++i) {
+        discovery->recomputeDigest();
+      }
+      measurement.report("recomputeDigest", profile.label_, size, repeatCount);
+    }
+    string objects;
+    {
+      Measurement measurement;
+      for (size_t i = 0; i < repeatCount; ++i) {
+        objects = discovery->objectsToString();
+      }
+      measurement.report("objectsToString", profile.label_, size, repeatCount);
+    }
+    {
+      Measurement measurement;
+      for (size_t i = 0; i < repeatCount; ++i) {
+        SyncBasedDiscovery::stringToObjects(objects);
+      }
+      measurement.report("stringToObjects", profile.label_, size, repeatCount);
+    }
+
+    // A peer's reply that differs from the objects in one name of every hundred
+    vector<string> reply = names;
+    vector<string> others = makeNames(size / 100 + 1, size);
+    for (size_t i = 0; i < others.size(); ++i) {
+      reply[i * 100 % reply.size()] = others[i];
+    }
+    sort(reply.begin(), reply.end());
+    runOnData(discovery, "onData sorted", profile.label_, reply, repeatCount);
+    shuffle(reply.begin(), reply.end(), random_);
+    runOnData(discovery, "onData unsorted", profile.label_, reply, repeatCount);
+
+    {
+      Measurement measurement;
+      for (size_t i = 0; i < names.size(); ++i) {
+        discovery->removeObject(names[i], false);
+      }
+      measurement.report("removeObject", profile.label_, size, names.size());
+    }
+  }
+
+  /**
+   * Time SyncDataCodec alone on a full list of size sorted names, in format.
+   */
+  void
+  runCodec(SyncDataFormat format, const string& label, size_t size)
+  {
+    vector<string> names = makeNames(size, 0);
+    sort(names.begin(), names.end());
+    vector<SyncDataCodec::Entry> entries;
+    for (size_t i = 0; i < names.size(); ++i) {
+      entries.push_back(SyncDataCodec::Entry(SyncDataCodec::OBJECT, names[i]));
+    }
+    size_t repeatCount = max((size_t)1, (size_t)100000 / size);
+
+    string content;
+    {
+      Measurement measurement;
+      for (size_t i = 0; i < repeatCount; ++i) {
+        SyncDataCodec::encode(format, entries, 0, (size_t)-1, content);
+      }
+      measurement.report("codec encode", label, size, repeatCount);
+    }
+    {
+      size_t nameBytes = 0;
+      Measurement measurement;
+      for (size_t i = 0; i < repeatCount; ++i) {
+        SyncDataCodec::decode
+          ((const uint8_t *)content.data(), content.size(), 
+           bind(&Benchmark::onEntry, ndn::func_lib::ref(nameBytes), _1, _2, _3));
+      }
+      measurement.report("codec decode", label, size, repeatCount);
+    }
+  }
+
+private:
+  static void
+  onEntry(size_t& nameBytes, SyncDataCodec::EntryType type, const char *name, size_t nameLength)
+  {
+    nameBytes += nameLength;
+  }
+
+  ptr_lib::shared_ptr<SyncBasedDiscovery>
+  makeDiscovery(const Profile& profile)
+  {
+    return ptr_lib::make_shared<SyncBasedDiscovery>
+      (broadcastPrefix_, bind(&Benchmark::onReceivedSyncData, this, _1), face_, scheduler_,
+       keyChain_, certificateName_, profile.digestType_, profile.digestLogLength_,
+       SyncDataFormat::TEXT, profile.ibltCellCount_);
+  }
+
+  /**
+   * Make size entity names like those of conferences under many hubs, in random order.
+   */
+  vector<string>
+  makeNames(size_t size, size_t first)
+  {
+    vector<string> names;
+    for (size_t i = first; i < first + size; ++i) {
+      ostringstream name;
+      name << "/ndn/edu/site" << i % 97 << "/ndnrtc/user/peer" << i << "/conference" << i % 7;
+      names.push_back(name.str());
+    }
+    shuffle(names.begin(), names.end(), random_);
+    return names;
+  }
+
+  void
+  runOnData
+    (const ptr_lib::shared_ptr<SyncBasedDiscovery>& discovery, const string& operation,
+     const string& label, const vector<string>& reply, size_t repeatCount)
+  {
+    vector<SyncDataCodec::Entry> entries;
+    for (size_t i = 0; i < reply.size(); ++i) {
+      entries.push_back(SyncDataCodec::Entry(SyncDataCodec::OBJECT, reply[i]));
+    }
+    string content;
+    SyncDataCodec::encode(SyncDataFormat::TEXT, entries, 0, (size_t)-1, content);
+
+    // onData looks at the names only for segment numbers
+    Name name(broadcastPrefix_);
+    name.append("digest");
+    ptr_lib::shared_ptr<Interest> interest(new Interest(name));
+    ptr_lib::shared_ptr<Data> data(new Data(name));
+    data->setContent(Blob((const uint8_t *)content.data(), content.size()));
+
+    // Differences go to onReceivedSyncData, which leaves the objects unchanged; each
+    // call also schedules the next sync interest, which is counted along
+    Measurement measurement;
+    for (size_t i = 0; i < repeatCount; ++i) {
+      discovery->onData(interest, data);
+    }
+    measurement.report(operation, label, reply.size(), repeatCount);
+  }
+
+  void
+  onReceivedSyncData(const vector<string>& differences)
+  {
+    differenceCount_ += differences.size();
+  }
+
+  Face& face_;
+  Scheduler& scheduler_;
+  KeyChain& keyChain_;
+  Name certificateName_;
+  Name broadcastPrefix_;
+  mt19937 random_;
+  uint64_t differenceCount_;
+};
+
+int
+main(int argc, char** argv)
+{
+  size_t largestSize = argc > 1 ? atoi(argv[1]) : 100000;
+
+  // The face is only passed along, so it never connects
+  Face face("localhost");
+  Scheduler scheduler;
+  // Using default keyChain in ndn-cpp
+  KeyChain keyChain;
+  Name certificateName = keyChain.getDefaultCertificateName();
+  Benchmark benchmark(face, scheduler, keyChain, certificateName);
+
+  cout << "Times are in nanoseconds per operation; onData operations are per reply." << endl;
+  cout << left << setw(18) << "operation" << setw(13) << "profile" << right
+       << setw(8) << "names" << setw(14) << "ns/op" << setw(12) << "allocs/op" << endl;
+
+  Profile profiles[] = {
+    { "default", SyncDigestType::SHA256_FULL, 0, 0 },
+    { "incremental", SyncDigestType::INCREMENTAL, 16, 64 }
+  };
+
+  for (size_t size = 10; size <= largestSize; size *= 10) {
+    for (size_t i = 0; i < sizeof(profiles) / sizeof(profiles[0]); ++i) {
+      benchmark.run(profiles[i], size);
+    }
+    benchmark.runCodec(SyncDataFormat::TEXT, "text", size);
+    benchmark.runCodec(SyncDataFormat::BINARY, "binary", size);
+  }
+  return 0;
+}
@@ -0,0 +1,545 @@
+#include "simulated-network.h"
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <time.h>
+#include <sys/time.h>
+
+using namespace std;
+using namespace ndn;
+using namespace ndn::func_lib;
+using namespace ndnrtc_addon;
+using namespace test;
+
+// The lifetime NFD gives an interest that doesn't set one
+static const Milliseconds DEFAULT_INTEREST_LIFETIME = 4000;
+
+// The number of content store entries looked at for a stale one to evict
+static const size_t EVICTION_SCAN = 16;
+
+// The period of PIT cleanups in run
+static const Milliseconds PIT_CLEANUP_INTERVAL = 1000;
+
+static Milliseconds
+getLifetime(const Interest& interest)
+{
+  Milliseconds lifetime = interest.getInterestLifetimeMilliseconds();
+  return lifetime >= 0 ? lifetime : DEFAULT_INTEREST_LIFETIME;
+}
+
+// The network whose clock ndn_getNowMilliseconds follows, if any
+static const SimulatedNetwork *clockNetwork = 0;
+
+/**
+ * ndn-cpp reads the current time with this C function, and MemoryContentCache ages
+ * content by it. Defined here, it's used in place of the library's, and follows the 
+ * virtual clock while a network exists.
+ */
+extern "C" MillisecondsSince1970
+ndn_getNowMilliseconds()
+{
+  if (clockNetwork) {
+    return clockNetwork->getNowMilliseconds();
+  }
+  struct timeval t;
+  gettimeofday(&t, 0);
+  return t.tv_sec * 1000.0 + t.tv_usec / 1000.0;
+}
+
+static double
+getThreadCpuMilliseconds()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+// The host is never connected to, since every method using the transport is overridden
+SimulatedFace::SimulatedFace(SimulatedNetwork& network)
+: Face("localhost"), network_(network), lastId_(0), cpuMilliseconds_(0)
+{
+  faceId_ = network_.attach(this);
+}
+
+SimulatedFace::~SimulatedFace()
+{
+  shutdown();
+  network_.detach(faceId_);
+}
+
+uint64_t
+SimulatedFace::expressInterest
+  (const Interest& interest, const OnData& onData, const OnTimeout& onTimeout,
+   WireFormat& wireFormat)
+{
+  uint64_t id = ++lastId_;
+  PendingInterest& pendingInterest = pendingInterests_[id];
+  pendingInterest.interest_.reset(new Interest(interest));
+  pendingInterest.onData_ = onData;
+  pendingInterest.onTimeout_ = onTimeout;
+  pendingInterest.timeoutEvent_ = network_.getScheduler().schedule
+    (getLifetime(interest), bind(&SimulatedFace::onTimeout, this, id));
+
+  ++counters_.interests_;
+  counters_.bytes_ += pendingInterest.interest_->wireEncode().size();
+  network_.sendInterest(faceId_, pendingInterest.interest_);
+  return id;
+}
+
+void
+SimulatedFace::removePendingInterest(uint64_t pendingInterestId)
+{
+  map<uint64_t, PendingInterest>::iterator item = pendingInterests_.find(pendingInterestId);
+  if (item != pendingInterests_.end()) {
+    item->second.timeoutEvent_.cancel();
+    pendingInterests_.erase(item);
+  }
+}
+
+uint64_t
+SimulatedFace::registerPrefix
+  (const Name& prefix, const OnInterestCallback& onInterest,
+   const OnRegisterFailed& onRegisterFailed, const OnRegisterSuccess& onRegisterSuccess,
+   const ForwardingFlags& flags, WireFormat& wireFormat)
+{
+  uint64_t id = ++lastId_;
+  Registration& registration = registrations_[id];
+  registration.prefix_.reset(new Name(prefix));
+  registration.filter_.reset(new InterestFilter(prefix));
+  registration.onInterest_ = onInterest;
+  network_.addRoute(prefix, faceId_);
+
+  // Registration never fails, but still completes later, as with a forwarder
+  if (onRegisterSuccess) {
+    network_.getScheduler().schedule(0, bind(onRegisterSuccess, registration.prefix_, id));
+  }
+  return id;
+}
+
+void
+SimulatedFace::removeRegisteredPrefix(uint64_t registeredPrefixId)
+{
+  map<uint64_t, Registration>::iterator item = registrations_.find(registeredPrefixId);
+  if (item != registrations_.end()) {
+    network_.removeRoute(*item->second.prefix_, faceId_);
+    registrations_.erase(item);
+  }
+}
+
+void
+SimulatedFace::putData(const Data& data, WireFormat& wireFormat)
+{
+  ptr_lib::shared_ptr<Data> copy(new Data(data));
+  ++counters_.data_;
+  counters_.bytes_ += copy->wireEncode().size();
+  network_.sendData(faceId_, copy);
+}
+
+void
+SimulatedFace::send(const uint8_t *encoding, size_t encodingLength)
+{
+  Data data;
+  data.wireDecode(encoding, encodingLength);
+  putData(data);
+}
+
+void
+SimulatedFace::shutdown()
+{
+  for (map<uint64_t, PendingInterest>::iterator it = pendingInterests_.begin();
+       it != pendingInterests_.end(); ++it) {
+    it->second.timeoutEvent_.cancel();
+  }
+  pendingInterests_.clear();
+
+  for (map<uint64_t, Registration>::iterator it = registrations_.begin();
+       it != registrations_.end(); ++it) {
+    network_.removeRoute(*it->second.prefix_, faceId_);
+  }
+  registrations_.clear();
+}
+
+void
+SimulatedFace::onInterest(const ptr_lib::shared_ptr<const Interest>& interest)
+{
+  // The callbacks may register or remove prefixes
+  vector<uint64_t> ids;
+  for (map<uint64_t, Registration>::iterator it = registrations_.begin();
+       it != registrations_.end(); ++it) {
+    if (it->second.prefix_->match(interest->getName())) {
+      ids.push_back(it->first);
+    }
+  }
+
+  double startTime = getThreadCpuMilliseconds();
+  for (size_t i = 0; i < ids.size(); ++i) {
+    map<uint64_t, Registration>::iterator item = registrations_.find(ids[i]);
+    if (item != registrations_.end()) {
+      Registration registration = item->second;
+      registration.onInterest_
+        (registration.prefix_, interest, *this, ids[i], registration.filter_);
+    }
+  }
+  cpuMilliseconds_ += getThreadCpuMilliseconds() - startTime;
+}
+
+void
+SimulatedFace::onData(const ptr_lib::shared_ptr<Data>& data)
+{
+  vector<PendingInterest> satisfied;
+  map<uint64_t, PendingInterest>::iterator it = pendingInterests_.begin();
+  while (it != pendingInterests_.end()) {
+    if (it->second.interest_->matchesName(data->getName())) {
+      it->second.timeoutEvent_.cancel();
+      satisfied.push_back(it->second);
+      pendingInterests_.erase(it++);
+    }
+    else {
+      ++it;
+    }
+  }
+
+  // The callbacks may express interests, so they run after the loop
+  double startTime = getThreadCpuMilliseconds();
+  for (size_t i = 0; i < satisfied.size(); ++i) {
+    if (satisfied[i].onData_) {
+      satisfied[i].onData_(satisfied[i].interest_, data);
+    }
+  }
+  cpuMilliseconds_ += getThreadCpuMilliseconds() - startTime;
+}
+
+void
+SimulatedFace::onTimeout(uint64_t pendingInterestId)
+{
+  map<uint64_t, PendingInterest>::iterator item = pendingInterests_.find(pendingInterestId);
+  if (item == pendingInterests_.end()) {
+    return;
+  }
+  PendingInterest pendingInterest = item->second;
+  pendingInterests_.erase(item);
+  if (pendingInterest.onTimeout_) {
+    double startTime = getThreadCpuMilliseconds();
+    pendingInterest.onTimeout_(pendingInterest.interest_);
+    cpuMilliseconds_ += getThreadCpuMilliseconds() - startTime;
+  }
+}
+
+SimulatedNetwork::SimulatedNetwork
+  (Milliseconds latency, Milliseconds jitter, double loss, size_t contentStoreCapacity,
+   unsigned int seed)
+: latency_(latency), jitter_(jitter), loss_(loss), contentStoreCapacity_(contentStoreCapacity),
+  random_(seed), now_(0), scheduler_(1, bind(&SimulatedNetwork::getNowMilliseconds, this)),
+  cacheHitCount_(0), aggregatedCount_(0)
+{
+  clockNetwork = this;
+}
+
+SimulatedNetwork::~SimulatedNetwork()
+{
+  if (clockNetwork == this) {
+    clockNetwork = 0;
+  }
+}
+
+void
+SimulatedNetwork::run(Milliseconds duration)
+{
+  MillisecondsSince1970 endTime = now_ + duration;
+  while (now_ < endTime) {
+    now_ += 1;
+    scheduler_.processEvents();
+    if (::fmod(now_, PIT_CLEANUP_INTERVAL) == 0) {
+      expirePit();
+    }
+  }
+}
+
+void
+SimulatedNetwork::resetCounters()
+{
+  counters_ = PacketCounters();
+  cacheHitCount_ = 0;
+  aggregatedCount_ = 0;
+  for (size_t i = 0; i < faces_.size(); ++i) {
+    if (faces_[i]) {
+      faces_[i]->resetCounters();
+    }
+  }
+}
+
+size_t
+SimulatedNetwork::attach(SimulatedFace *face)
+{
+  faces_.push_back(face);
+  return faces_.size() - 1;
+}
+
+void
+SimulatedNetwork::detach(size_t faceId)
+{
+  // Packets on their way to the face find it gone
+  faces_[faceId] = 0;
+}
+
+void
+SimulatedNetwork::sendInterest
+  (size_t faceId, const ptr_lib::shared_ptr<const Interest>& interest)
+{
+  Milliseconds delay = getLinkDelay();
+  if (delay >= 0) {
+    ++counters_.interests_;
+    counters_.bytes_ += interest->wireEncode().size();
+    scheduler_.schedule
+      (delay, bind(&SimulatedNetwork::onInterestAtForwarder, this, faceId, interest));
+  }
+}
+
+void
+SimulatedNetwork::sendData(size_t faceId, const ptr_lib::shared_ptr<Data>& data)
+{
+  Milliseconds delay = getLinkDelay();
+  if (delay >= 0) {
+    ++counters_.data_;
+    counters_.bytes_ += data->wireEncode().size();
+    scheduler_.schedule
+      (delay, bind(&SimulatedNetwork::onDataAtForwarder, this, faceId, data));
+  }
+}
+
+void
+SimulatedNetwork::deliverInterest
+  (size_t faceId, const ptr_lib::shared_ptr<const Interest>& interest)
+{
+  Milliseconds delay = getLinkDelay();
+  if (delay >= 0) {
+    ++counters_.interests_;
+    counters_.bytes_ += interest->wireEncode().size();
+    scheduler_.schedule
+      (delay, bind(&SimulatedNetwork::onInterestAtFace, this, faceId, interest));
+  }
+}
+
+void
+SimulatedNetwork::deliverData(size_t faceId, const ptr_lib::shared_ptr<Data>& data)
+{
+  Milliseconds delay = getLinkDelay();
+  if (delay >= 0) {
+    ++counters_.data_;
+    counters_.bytes_ += data->wireEncode().size();
+    scheduler_.schedule
+      (delay, bind(&SimulatedNetwork::onDataAtFace, this, faceId, data));
+  }
+}
+
+void
+SimulatedNetwork::onInterestAtFace
+  (size_t faceId, const ptr_lib::shared_ptr<const Interest>& interest)
+{
+  if (faces_[faceId]) {
+    faces_[faceId]->onInterest(interest);
+  }
+}
+
+void
+SimulatedNetwork::onDataAtFace(size_t faceId, const ptr_lib::shared_ptr<Data>& data)
+{
+  if (faces_[faceId]) {
+    faces_[faceId]->onData(data);
+  }
+}
+
+void
+SimulatedNetwork::onInterestAtForwarder
+  (size_t faceId, const ptr_lib::shared_ptr<const Interest>& interest)
+{
+  ptr_lib::shared_ptr<Data> data = findInContentStore(*interest);
+  if (data) {
+    ++cacheHitCount_;
+    deliverData(faceId, data);
+    return;
+  }
+
+  MillisecondsSince1970 expiry = now_ + getLifetime(*interest);
+  vector<PitEntry>& entries = pit_[interest->getName()];
+  vector<PitEntry>::iterator entry = entries.begin();
+  for (; entry != entries.end(); ++entry) {
+    if (entry->expiry_ > now_ &&
+        entry->interest_->getMustBeFresh() == interest->getMustBeFresh()) {
+      break;
+    }
+  }
+
+  if (entry == entries.end()) {
+    PitEntry newEntry;
+    newEntry.interest_ = interest;
+    newEntry.expiry_ = expiry;
+    newEntry.inFaces_.push_back(faceId);
+    entries.push_back(newEntry);
+  }
+  else {
+    entry->expiry_ = max(entry->expiry_, expiry);
+    // A retransmission from the same face is forwarded again, as NFD does
+    if (find(entry->inFaces_.begin(), entry->inFaces_.end(), faceId) == entry->inFaces_.end()) {
+      entry->inFaces_.push_back(faceId);
+      ++aggregatedCount_;
+      return;
+    }
+  }
+
+  // Multicast to every face with a matching registration, except the one it came from
+  set<size_t> outFaces;
+  const Name& name = interest->getName();
+  for (size_t i = 0; i <= name.size(); ++i) {
+    map<Name, map<size_t, size_t> >::iterator route = fib_.find(name.getPrefix(i));
+    if (route == fib_.end()) {
+      continue;
+    }
+    for (map<size_t, size_t>::iterator it = route->second.begin();
+         it != route->second.end(); ++it) {
+      if (it->first != faceId) {
+        outFaces.insert(it->first);
+      }
+    }
+  }
+  for (set<size_t>::iterator it = outFaces.begin(); it != outFaces.end(); ++it) {
+    deliverInterest(*it, interest);
+  }
+}
+
+void
+SimulatedNetwork::onDataAtForwarder(size_t faceId, const ptr_lib::shared_ptr<Data>& data)
+{
+  set<size_t> outFaces;
+  const Name& name = data->getName();
+  for (size_t i = 0; i <= name.size(); ++i) {
+    map<Name, vector<PitEntry> >::iterator item = pit_.find(name.getPrefix(i));
+    if (item == pit_.end()) {
+      continue;
+    }
+    vector<PitEntry>& entries = item->second;
+    for (size_t j = 0; j < entries.size(); ) {
+      if (entries[j].expiry_ > now_ && !entries[j].interest_->matchesName(name)) {
+        ++j;
+        continue;
+      }
+      if (entries[j].expiry_ > now_) {
+        outFaces.insert(entries[j].inFaces_.begin(), entries[j].inFaces_.end());
+      }
+      entries.erase(entries.begin() + j);
+    }
+    if (entries.empty()) {
+      pit_.erase(item);
+    }
+  }
+
+  // Unsolicited data is dropped, and not cached
+  if (outFaces.empty()) {
+    return;
+  }
+  addToContentStore(data);
+  outFaces.erase(faceId);
+  for (set<size_t>::iterator it = outFaces.begin(); it != outFaces.end(); ++it) {
+    deliverData(*it, data);
+  }
+}
+
+void
+SimulatedNetwork::addRoute(const Name& prefix, size_t faceId)
+{
+  ++fib_[prefix][faceId];
+}
+
+void
+SimulatedNetwork::removeRoute(const Name& prefix, size_t faceId)
+{
+  map<Name, map<size_t, size_t> >::iterator route = fib_.find(prefix);
+  if (route == fib_.end()) {
+    return;
+  }
+  map<size_t, size_t>::iterator item = route->second.find(faceId);
+  if (item != route->second.end() && --item->second == 0) {
+    route->second.erase(item);
+    if (route->second.empty()) {
+      fib_.erase(route);
+    }
+  }
+}
+
+void
+SimulatedNetwork::expirePit()
+{
+  map<Name, vector<PitEntry> >::iterator item = pit_.begin();
+  while (item != pit_.end()) {
+    vector<PitEntry>& entries = item->second;
+    for (size_t i = 0; i < entries.size(); ) {
+      if (entries[i].expiry_ <= now_) {
+        entries.erase(entries.begin() + i);
+      }
+      else {
+        ++i;
+      }
+    }
+    if (entries.empty()) {
+      pit_.erase(item++);
+    }
+    else {
+      ++item;
+    }
+  }
+}
+
+Milliseconds
+SimulatedNetwork::getLinkDelay()
+{
+  uniform_real_distribution<double> uniform(0, 1);
+  if (loss_ > 0 && uniform(random_) < loss_) {
+    ++counters_.lost_;
+    return -1;
+  }
+  return jitter_ > 0 ? latency_ + ::floor(uniform(random_) * jitter_) : latency_;
+}
+
+void
+SimulatedNetwork::addToContentStore(const ptr_lib::shared_ptr<Data>& data)
+{
+  if (contentStoreCapacity_ == 0) {
+    return;
+  }
+
+  Milliseconds freshnessPeriod = data->getMetaInfo().getFreshnessPeriod();
+  CsEntry& entry = contentStore_[data->getName()];
+  entry.data_ = data;
+  entry.staleTime_ = now_ + (freshnessPeriod > 0 ? freshnessPeriod : 0);
+
+  while (contentStore_.size() > contentStoreCapacity_) {
+    // Evict a stale entry if one is near the front, else the first one
+    map<Name, CsEntry>::iterator victim = contentStore_.begin();
+    map<Name, CsEntry>::iterator it = contentStore_.begin();
+    for (size_t i = 0; i < EVICTION_SCAN && it != contentStore_.end(); ++i, ++it) {
+      if (it->second.staleTime_ <= now_ && it->second.data_ != data) {
+        victim = it;
+        break;
+      }
+    }
+    if (victim->second.data_ == data) {
+      ++victim;
+    }
+    contentStore_.erase(victim);
+  }
+}
+
+ptr_lib::shared_ptr<Data>
+SimulatedNetwork::findInContentStore(const Interest& interest)
+{
+  const Name& name = interest.getName();
+  for (map<Name, CsEntry>::iterator it = contentStore_.lower_bound(name);
+       it != contentStore_.end() && name.match(it->first); ++it) {
+    if ((!interest.getMustBeFresh() || it->second.staleTime_ > now_) &&
+        interest.matchesName(it->first)) {
+      return it->second.data_;
+    }
+  }
+  return ptr_lib::shared_ptr<Data>();
+}
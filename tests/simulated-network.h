@@ -0,0 +1,325 @@
+// An in-process stand-in for NFD and the faces connected to it, on a virtual clock,
+// so that many EntityDiscovery and Chat instances can run in one process, without a
+// forwarder, and the time they take and the packets they send can be measured.
+
+#ifndef __ndnrtc__addon__simulated__network__
+#define __ndnrtc__addon__simulated__network__
+
+#include <ndn-cpp/ndn-cpp-config.h>
+#include <ndn-cpp/face.hpp>
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include "scheduler.h"
+
+namespace test
+{
+  class SimulatedNetwork;
+
+  /**
+   * Packet counts, for a face or the whole network.
+   */
+  class PacketCounters {
+  public:
+    PacketCounters()
+    : interests_(0), data_(0), bytes_(0), lost_(0)
+    {}
+
+    // Sent by a face, or carried over the links of the network
+    uint64_t interests_;
+    uint64_t data_;
+    uint64_t bytes_;
+    // Dropped on a link
+    uint64_t lost_;
+  };
+
+  /**
+   * A Face connected to a SimulatedNetwork. It overrides every Face method that would
+   * use the transport, so it never connects to a forwarder; processEvents does nothing,
+   * since the network delivers packets from its scheduler.
+   */
+  class SimulatedFace : public ndn::Face
+  {
+  public:
+    SimulatedFace(SimulatedNetwork& network);
+
+    virtual
+    ~SimulatedFace();
+
+    // The other overloads call the virtual methods below
+    using ndn::Face::expressInterest;
+    using ndn::Face::registerPrefix;
+    using ndn::Face::send;
+
+    virtual uint64_t
+    expressInterest
+      (const ndn::Interest& interest, const ndn::OnData& onData,
+       const ndn::OnTimeout& onTimeout = ndn::OnTimeout(),
+       ndn::WireFormat& wireFormat = *ndn::WireFormat::getDefaultWireFormat());
+
+    virtual void
+    removePendingInterest(uint64_t pendingInterestId);
+
+    virtual uint64_t
+    registerPrefix
+      (const ndn::Name& prefix, const ndn::OnInterestCallback& onInterest,
+       const ndn::OnRegisterFailed& onRegisterFailed,
+       const ndn::OnRegisterSuccess& onRegisterSuccess,
+       const ndn::ForwardingFlags& flags = ndn::ForwardingFlags(),
+       ndn::WireFormat& wireFormat = *ndn::WireFormat::getDefaultWireFormat());
+
+    virtual void
+    removeRegisteredPrefix(uint64_t registeredPrefixId);
+
+    virtual void
+    putData
+      (const ndn::Data& data, 
+       ndn::WireFormat& wireFormat = *ndn::WireFormat::getDefaultWireFormat());
+
+    /**
+     * Send a wire-encoded Data, as MemoryContentCache does.
+     */
+    virtual void
+    send(const uint8_t *encoding, size_t encodingLength);
+
+    virtual void
+    processEvents() {}
+
+    virtual bool
+    isLocal() { return true; }
+
+    virtual void
+    shutdown();
+
+    const PacketCounters&
+    getCounters() const { return counters_; }
+
+    /**
+     * Reset the packet counters and the CPU time.
+     */
+    void
+    resetCounters()
+    {
+      counters_ = PacketCounters();
+      cpuMilliseconds_ = 0;
+    }
+
+    /**
+     * Return the CPU time spent in the callbacks of the interests, data and timeouts
+     * delivered to this face, in milliseconds.
+     */
+    double
+    getCpuMilliseconds() const { return cpuMilliseconds_; }
+
+  private:
+    friend class SimulatedNetwork;
+
+    class PendingInterest {
+    public:
+      ndn::ptr_lib::shared_ptr<const ndn::Interest> interest_;
+      ndn::OnData onData_;
+      ndn::OnTimeout onTimeout_;
+      ndnrtc_addon::Scheduler::EventHandle timeoutEvent_;
+    };
+
+    class Registration {
+    public:
+      ndn::ptr_lib::shared_ptr<const ndn::Name> prefix_;
+      ndn::ptr_lib::shared_ptr<const ndn::InterestFilter> filter_;
+      ndn::OnInterestCallback onInterest_;
+    };
+
+    /**
+     * Called by the network when interest arrives for a prefix registered here.
+     */
+    void
+    onInterest(const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest);
+
+    /**
+     * Called by the network when data arrives for interests expressed here.
+     */
+    void
+    onData(const ndn::ptr_lib::shared_ptr<ndn::Data>& data);
+
+    void
+    onTimeout(uint64_t pendingInterestId);
+
+    SimulatedNetwork& network_;
+    size_t faceId_;
+    uint64_t lastId_;
+    std::map<uint64_t, PendingInterest> pendingInterests_;
+    std::map<uint64_t, Registration> registrations_;
+    PacketCounters counters_;
+    double cpuMilliseconds_;
+  };
+
+  /**
+   * SimulatedNetwork is one forwarder, with every SimulatedFace on a link of its own.
+   * Each link adds latency plus up to jitter milliseconds, and drops packets with the
+   * probability loss. The forwarder keeps a PIT, aggregating interests of the same
+   * name, and a content store honoring freshness periods, and sends interests to every
+   * face that registered a matching prefix, as the multicast strategy does.
+   *
+   * Time is virtual: it only advances in run, which processes the network's scheduler,
+   * one tick at a time. The EntityDiscovery and Chat instances on the network should
+   * use getScheduler(), so that their heartbeats and timeouts follow the same clock.
+   * ndn-cpp's MemoryContentCache ages content by ndn_getNowMilliseconds, which programs 
+   * linked with the network get from simulated-network.cpp in place of the library's: 
+   * it follows the clock of the network constructed last while that one exists, so 
+   * that cached sync replies go stale after their freshness period in virtual time.
+   */
+  class SimulatedNetwork
+  {
+  public:
+    /**
+     * @param latency The one-way delay of each link in milliseconds.
+     * @param jitter The largest random delay added to latency.
+     * @param loss The probability that a link drops a packet.
+     * @param contentStoreCapacity The number of Data packets the forwarder caches.
+     * @param seed The seed of the jitter and loss, so that runs can be repeated.
+     */
+    SimulatedNetwork
+      (ndn::Milliseconds latency = 5, ndn::Milliseconds jitter = 0, double loss = 0,
+       size_t contentStoreCapacity = 1000, unsigned int seed = 1);
+
+    ~SimulatedNetwork();
+
+    ndnrtc_addon::Scheduler&
+    getScheduler() { return scheduler_; }
+
+    ndn::MillisecondsSince1970
+    getNowMilliseconds() const { return now_; }
+
+    /**
+     * Advance the virtual clock by duration, running everything that's due.
+     */
+    void
+    run(ndn::Milliseconds duration);
+
+    const PacketCounters&
+    getCounters() const { return counters_; }
+
+    /**
+     * Return the number of interests answered from the content store.
+     */
+    uint64_t
+    getCacheHitCount() const { return cacheHitCount_; }
+
+    /**
+     * Return the number of interests aggregated with a pending interest of the same name.
+     */
+    uint64_t
+    getAggregatedCount() const { return aggregatedCount_; }
+
+    void
+    resetCounters();
+
+  private:
+    friend class SimulatedFace;
+
+    class PitEntry {
+    public:
+      ndn::ptr_lib::shared_ptr<const ndn::Interest> interest_;
+      ndn::MillisecondsSince1970 expiry_;
+      std::vector<size_t> inFaces_;
+    };
+
+    class CsEntry {
+    public:
+      ndn::ptr_lib::shared_ptr<ndn::Data> data_;
+      ndn::MillisecondsSince1970 staleTime_;
+    };
+
+    size_t
+    attach(SimulatedFace *face);
+
+    void
+    detach(size_t faceId);
+
+    /**
+     * Send interest from the face faceId over its link to the forwarder.
+     */
+    void
+    sendInterest(size_t faceId, const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest);
+
+    /**
+     * Send data from the face faceId over its link to the forwarder.
+     */
+    void
+    sendData(size_t faceId, const ndn::ptr_lib::shared_ptr<ndn::Data>& data);
+
+    void
+    onInterestAtForwarder(size_t faceId, const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest);
+
+    void
+    onDataAtForwarder(size_t faceId, const ndn::ptr_lib::shared_ptr<ndn::Data>& data);
+
+    /**
+     * Send interest from the forwarder over the link of the face faceId.
+     */
+    void
+    deliverInterest(size_t faceId, const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest);
+
+    /**
+     * Send data from the forwarder over the link of the face faceId.
+     */
+    void
+    deliverData(size_t faceId, const ndn::ptr_lib::shared_ptr<ndn::Data>& data);
+
+    void
+    onInterestAtFace(size_t faceId, const ndn::ptr_lib::shared_ptr<const ndn::Interest>& interest);
+
+    void
+    onDataAtFace(size_t faceId, const ndn::ptr_lib::shared_ptr<ndn::Data>& data);
+
+    void
+    addRoute(const ndn::Name& prefix, size_t faceId);
+
+    void
+    removeRoute(const ndn::Name& prefix, size_t faceId);
+
+    /**
+     * Drop the PIT entries that expired.
+     */
+    void
+    expirePit();
+
+    /**
+     * Return the delay of a packet over a link, or -1 if the link drops it.
+     */
+    ndn::Milliseconds
+    getLinkDelay();
+
+    void
+    addToContentStore(const ndn::ptr_lib::shared_ptr<ndn::Data>& data);
+
+    ndn::ptr_lib::shared_ptr<ndn::Data>
+    findInContentStore(const ndn::Interest& interest);
+
+    ndn::Milliseconds latency_;
+    ndn::Milliseconds jitter_;
+    double loss_;
+    size_t contentStoreCapacity_;
+    std::mt19937 random_;
+
+    ndn::MillisecondsSince1970 now_;
+    ndnrtc_addon::Scheduler scheduler_;
+
+    // Attached faces by id; detached ones are null
+    std::vector<SimulatedFace *> faces_;
+    // Registered prefixes, with the number of registrations of each face
+    std::map<ndn::Name, std::map<size_t, size_t> > fib_;
+    // Pending interests by name
+    std::map<ndn::Name, std::vector<PitEntry> > pit_;
+    // Cached Data by name, which keeps the names under a prefix together
+    std::map<ndn::Name, CsEntry> contentStore_;
+
+    PacketCounters counters_;
+    uint64_t cacheHitCount_;
+    uint64_t aggregatedCount_;
+  };
+}
+
+#endif
@@ -6,6 +6,7 @@
 using namespace chrono_chat;
 using namespace entity_discovery;
 using namespace std;
+using namespace ndnrtc_addon;
 
 using namespace test;
 
@@ -121,9 +122,13 @@ int main()
   std::string conferenceDiscoveryBdcastPrefix = "/ndn/broadcast/ndnrtc/conferences";
   
   Face face;
+  // Delays of chat and discovery are run by processing the scheduler along with face
+  Scheduler scheduler;
   // Using default keyChain in ndn-cpp
   KeyChain keyChain;
   Name certificateName = keyChain.getDefaultCertificateName();
+  // Chat and discovery count into one registry, printed by -metrics
+  ptr_lib::shared_ptr<MetricsRegistry> metrics(new MetricsRegistry());
   
   face.setCommandSigningInfo(keyChain, keyChain.getDefaultCertificateName());
   
@@ -132,7 +137,8 @@ int main()
   try {
     chat.reset
       (new Chat(chatBroadcastPrefix, screenName, chatroom,
-         hubPrefix, NULL, face, keyChain, certificateName));
+         hubPrefix, NULL, face, scheduler, keyChain, certificateName, 10000, 20000,
+         metrics));
       chat->start();
       
       ptr_lib::shared_ptr<ConferenceDescriptionSerializer> serializer(new ConferenceDescriptionSerializer());
@@ -140,7 +146,8 @@ int main()
       discovery.reset
         (new EntityDiscovery(conferenceDiscoveryBdcastPrefix, 
          NULL, serializer, 
-         face, keyChain, certificateName));
+         face, scheduler, keyChain, certificateName, SyncDigestType::SHA256_FULL, 0,
+         SyncDataFormat::TEXT, 0, 256, 0, HeartbeatPolicy(), metrics));
       discovery->start();
   }
   catch (std::exception& e) {
@@ -178,6 +185,10 @@ int main()
           (msgString.substr(string("-start ").size(), space - string("-start ").size()), hubPrefix, ptr_lib::make_shared<ConferenceDescription>(thisConference));
         continue;
       }
+      if (msgString == "-metrics") {
+        cout << metrics->snapshot().toString();
+        continue;
+      }
       if (msgString.find("-show ") != std::string::npos) {
         ptr_lib::shared_ptr<ConferenceDescription> description = 
           ptr_lib::dynamic_pointer_cast<ConferenceDescription>
@@ -192,6 +203,7 @@ int main()
     }
     try {
       face.processEvents();
+      scheduler.processEvents();
     }
     catch (std::exception& e) {
       cout << e.what() << endl;
@@ -203,6 +215,7 @@ int main()
   int sleepSeconds = 0;
   while (sleepSeconds < 1000000) {
     face.processEvents();
+    scheduler.processEvents();
     usleep(10000);
     sleepSeconds += 10000;
   }
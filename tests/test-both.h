@@ -81,13 +81,8 @@ namespace test
     deserialize(Blob srcBlob)
     {
       //cout << "deserialize from blob not implemented." << endl;
-      string content = "";
-      for (size_t i = 0; i < srcBlob.size(); ++i) {
-        content += (*srcBlob)[i];
-      }
-      
       ConferenceDescription cd;
-      cd.setDescription(content);
+      cd.setDescription(string((const char *)srcBlob.buf(), srcBlob.size()));
       return ptr_lib::make_shared<ConferenceDescription>(cd);
     }    
   };
@@ -8,6 +8,7 @@
 using namespace chrono_chat;
 using namespace entity_discovery;
 using namespace std;
+using namespace ndnrtc_addon;
 using namespace ndn;
 
 static const char *WHITESPACE_CHARS = " \n\r\t";
@@ -152,6 +153,8 @@ int main()
   Name chatBroadcastPrefix("/ndn/broadcast/chrono-chat/");
 
   Face face;
+  // Delays of chat are run by processing the scheduler along with face
+  Scheduler scheduler;
   // Using default keyChain in ndn-cpp
   KeyChain keyChain;
   Name certificateName = keyChain.getDefaultCertificateName();
@@ -174,7 +177,7 @@ int main()
       observers[i]->chat.reset
         (new Chat(chatBroadcastPrefix, screenName, ss.str(),
            hubPrefix, observers[i],
-           face, keyChain, certificateName));
+           face, scheduler, keyChain, certificateName));
 
       observers[i]->chat->start();
       usleep(500000);
@@ -204,7 +207,7 @@ int main()
         observers[0]->chat.reset
           (new Chat(chatBroadcastPrefix, screenName, ss.str(),
              hubPrefix, observers[0],
-             face, keyChain, certificateName));
+             face, scheduler, keyChain, certificateName));
 
         observers[0]->chat->start();
         std::cout << "Chat started." << endl;
@@ -228,6 +231,7 @@ int main()
           observers[0]->chat->sendMessage(ss.str());
           for (int j = 0; j < 100; j++) {
                 face.processEvents();
+                scheduler.processEvents();
                 usleep(2000);
           }
         }
@@ -238,6 +242,7 @@ int main()
     }
 
     face.processEvents();
+    scheduler.processEvents();
     usleep(10000);
   }
   // chatObserver.chat->leave();
@@ -245,6 +250,7 @@ int main()
   int sleepSeconds = 0;
   while (sleepSeconds < 1000000) {
     face.processEvents();
+    scheduler.processEvents();
     usleep(10000);
     sleepSeconds += 10000;
   }
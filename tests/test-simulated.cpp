@@ -0,0 +1,166 @@
+// Runs peers with EntityDiscovery and Chat on a SimulatedNetwork, each publishing one
+// entity and sending one chat message, and reports how long discovery and chat take to
+// reach every peer, in virtual time, and the packets it takes.
+//
+// Usage: test-simulated [peers] [latency ms] [loss]
+
+#include "test-both.h"
+#include "simulated-network.h"
+
+#include <cstdlib>
+#include <sstream>
+
+using namespace chrono_chat;
+using namespace entity_discovery;
+using namespace std;
+using namespace ndnrtc_addon;
+
+using namespace test;
+
+namespace test
+{
+  class CountingChatObserver : public ChatObserver
+  {
+  public:
+    CountingChatObserver(const string& screenName)
+    : screenName_(screenName), receivedCount_(0)
+    {}
+
+    void onStateChanged(chrono_chat::MessageTypes type, const char *prefix, const char *userName, const char *msg, double timestamp)
+    {
+      // Chat also reports the messages sent here
+      if (type == chrono_chat::MessageTypes::CHAT && screenName_ != userName) {
+        ++receivedCount_;
+      }
+    }
+
+    string screenName_;
+    size_t receivedCount_;
+  };
+
+  class Peer
+  {
+  public:
+    Peer
+      (SimulatedNetwork& network, size_t index, KeyChain& keyChain,
+       const Name& certificateName)
+    : face_(network)
+    {
+      ostringstream screenName;
+      screenName << "peer" << index;
+      hubPrefix_ = Name("/sim").append(screenName.str());
+      chatObserver_.reset(new CountingChatObserver(screenName.str()));
+
+      discovery_.reset
+        (new EntityDiscovery("/ndn/broadcast/ndnrtc/conferences", NULL,
+           ptr_lib::make_shared<ConferenceDescriptionSerializer>(),
+           face_, network.getScheduler(), keyChain, certificateName));
+      chat_.reset
+        (new Chat(Name("/ndn/broadcast/chrono-chat"), screenName.str(), "simchat",
+           hubPrefix_, chatObserver_.get(), face_, network.getScheduler(), keyChain,
+           certificateName));
+    }
+
+    SimulatedFace face_;
+    Name hubPrefix_;
+    ptr_lib::shared_ptr<CountingChatObserver> chatObserver_;
+    ptr_lib::shared_ptr<EntityDiscovery> discovery_;
+    ptr_lib::shared_ptr<Chat> chat_;
+  };
+}
+
+/**
+ * Run network in steps of step milliseconds, until isDone or limit milliseconds.
+ * @return The virtual time it took, or -1 if limit was reached.
+ */
+template<class Predicate> static Milliseconds
+runUntil(SimulatedNetwork& network, Predicate isDone, Milliseconds step, Milliseconds limit)
+{
+  MillisecondsSince1970 startTime = network.getNowMilliseconds();
+  while (!isDone()) {
+    if (network.getNowMilliseconds() - startTime >= limit) {
+      return -1;
+    }
+    network.run(step);
+  }
+  return network.getNowMilliseconds() - startTime;
+}
+
+static void
+report(const string& label, Milliseconds duration, SimulatedNetwork& network)
+{
+  const PacketCounters& counters = network.getCounters();
+  cout << label << ": ";
+  if (duration < 0) {
+    cout << "not done";
+  }
+  else {
+    cout << duration << " ms";
+  }
+  cout << ", " << counters.interests_ << " interests, " << counters.data_ << " data, "
+       << counters.bytes_ << " bytes, " << counters.lost_ << " lost, "
+       << network.getCacheHitCount() << " cache hits, "
+       << network.getAggregatedCount() << " aggregated" << endl;
+}
+
+int
+main(int argc, char** argv)
+{
+  size_t peerCount = argc > 1 ? atoi(argv[1]) : 10;
+  Milliseconds latency = argc > 2 ? atof(argv[2]) : 5;
+  double loss = argc > 3 ? atof(argv[3]) : 0;
+
+  SimulatedNetwork network(latency, latency / 2, loss);
+  // Using default keyChain in ndn-cpp
+  KeyChain keyChain;
+  Name certificateName = keyChain.getDefaultCertificateName();
+
+  vector<ptr_lib::shared_ptr<Peer> > peers;
+  for (size_t i = 0; i < peerCount; ++i) {
+    peers.push_back(ptr_lib::make_shared<Peer>(network, i, keyChain, certificateName));
+    peers.back()->discovery_->start();
+    peers.back()->chat_->start();
+  }
+  // Let every peer join the chat before anything is published
+  network.run(1000);
+  network.resetCounters();
+
+  for (size_t i = 0; i < peerCount; ++i) {
+    ostringstream entityName;
+    entityName << "conference" << i;
+    ConferenceDescription description;
+    description.setDescription("description: " + entityName.str());
+    peers[i]->discovery_->publishEntity
+      (entityName.str(), peers[i]->hubPrefix_,
+       ptr_lib::make_shared<ConferenceDescription>(description));
+  }
+  Milliseconds duration = runUntil(network, [&]() {
+    for (size_t i = 0; i < peerCount; ++i) {
+      if (peers[i]->discovery_->getDiscoveredEntityList().size() < peerCount - 1) {
+        return false;
+      }
+    }
+    return true;
+  }, 10, 60000);
+  report("discovery", duration, network);
+
+  network.resetCounters();
+  for (size_t i = 0; i < peerCount; ++i) {
+    peers[i]->chat_->sendMessage("hello");
+  }
+  duration = runUntil(network, [&]() {
+    for (size_t i = 0; i < peerCount; ++i) {
+      if (peers[i]->chatObserver_->receivedCount_ < peerCount - 1) {
+        return false;
+      }
+    }
+    return true;
+  }, 10, 60000);
+  report("chat", duration, network);
+
+  for (size_t i = 0; i < peerCount; ++i) {
+    peers[i]->chat_->shutdown();
+    peers[i]->discovery_->shutdown();
+  }
+  return 0;
+}